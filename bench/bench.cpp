@@ -0,0 +1,306 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "buzzer.h"
+#include "capture.h"
+#include "input.h"
+#include "jit.h"
+#include "lockstep.h"
+#include "octopus.h"
+#include "rewind.h"
+#include "rom.h"
+#include "runahead.h"
+#include "sync.h"
+
+#define DEFAULT_CYCLES 50000000
+#define CYCLES_PER_TICK 10
+// Frames run before timing, so one-time work like decoding or translating blocks is not measured
+#define WARMUP_FRAMES 600
+// Fixed, so ROMs that use RND take the same path on every run
+#define SEED 0
+// Instances the lockstep core runs side by side
+#define LANES 32
+// The window's rewind history
+#define REWIND_CAPACITY (512 * 1024)
+// Frames between the key presses and releases the frontend frames feed in
+#define KEY_PERIOD 30
+// Where the frontend frames capture to, so the capture costs what encoding and writing it does and nothing fills up
+#define CAPTURE_SINK "/dev/null"
+
+// Every heap allocation in the process goes through here, so the timed loop can report how many it made
+static uint64_t allocations = 0;
+
+void* operator new(const size_t size) {
+    allocations++;
+    if(void* memory = std::malloc(size > 0 ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, const size_t) noexcept {
+    std::free(memory);
+}
+
+// \brief A program to measure, either a ROM file or one of the synthetic ones below
+struct Workload {
+    std::string name;
+    std::string rom_path;
+    std::vector<uint16_t> opcodes;
+};
+
+struct Result {
+    std::string name;
+    double seconds;
+    // \brief Instructions executed in the timed loop, by every instance together
+    uint64_t instructions;
+    uint64_t allocated;
+    // \brief Frames run-ahead handed over clean, which the renderer would skip instead of presenting
+    uint64_t dropped;
+};
+
+enum class Core : uint8_t { INTERPRETER, JIT, LOCKSTEP };
+
+// Endless loops that each spend nearly all of their cycles on one class of opcodes, so their time per instruction is that of the class
+const std::vector<Workload> synthetic = {
+    {"synthetic/alu", "", {
+        0x6001, 0x6103, 0x6207,
+        0x8014, 0x8125, 0x7203, 0x8011, 0x8122, 0x8203, 0x8016, 0x812e, 0x8017, 0x8120, 0x1206,
+    }},
+    {"synthetic/drw", "", {
+        0xa000, 0x6000, 0x6100,
+        0xd015, 0x7005, 0xd015, 0x7105, 0xd015, 0x7003, 0xd015, 0x1206,
+    }},
+    {"synthetic/branch", "", {
+        0x6000, 0x6140,
+        0x7001, 0x4080, 0x6000, 0x5010, 0x2218, 0x9010, 0x1204, 0x3000, 0x1204, 0x1204,
+        0x00ee,
+    }},
+    {"synthetic/memory", "", {
+        0xa300,
+        0xff55, 0xff65, 0x7001, 0xff55, 0xff65, 0x7101, 0x1202,
+    }},
+};
+
+// Draws a sprite and sounds the buzzer every few frames and idles on DT in between, so with run-ahead some frames are drawn only in the real frames, or only in the ones run ahead
+const Workload paced = {"synthetic/paced", "", {
+    0x6003, 0xa000, 0x6100,
+    0xd115, 0xf015, 0xf018, 0xf207, 0x3200, 0x120c, 0x7108, 0x1206,
+}};
+
+// \brief What emulate in main.cpp does around every frame besides running it: key events, the buzzer, the capture, the rewind history and handing the framebuffer to the renderer
+struct Frontend {
+    InputQueue input;
+    Buzzer buzzer;
+    // \brief Stands in for SFML's audio thread
+    int16_t chunk[Buzzer::SAMPLES_PER_FRAME];
+    Capture capture{CAPTURE_SINK};
+    Rewind history{REWIND_CAPACITY};
+    State state;
+};
+
+Result measure(const Workload&, const uint64_t, const Core, const uint32_t, const bool);
+Result measure_lockstep(const Workload&, const uint64_t);
+std::vector<uint8_t> read_workload(const Workload&);
+void run_frame(CPU&, JIT*);
+std::string escape(const std::string&);
+
+int32_t main(int32_t argc, char* argv[]) {
+    uint64_t cycles = DEFAULT_CYCLES;
+    auto core = Core::INTERPRETER;
+    auto json = false;
+    uint32_t ahead = 0;
+    auto frontend = false;
+    auto workloads = synthetic;
+
+    for(int32_t index = 1; index < argc; index++) {
+        const auto argument = std::string(argv[index]);
+        if(argument == "--cycles" && index + 1 < argc) {
+            cycles = std::stoull(argv[++index]);
+        } else if(argument == "--core=jit") {
+            core = Core::JIT;
+        } else if(argument == "--core=interpreter") {
+            core = Core::INTERPRETER;
+        } else if(argument == "--core=lockstep") {
+            core = Core::LOCKSTEP;
+        } else if(argument == "--json") {
+            json = true;
+        } else if(argument == "--run-ahead" && index + 1 < argc) {
+            ahead = std::stoul(argv[++index]);
+        } else if(argument == "--frontend") {
+            frontend = true;
+        } else if(argument.starts_with("--")) {
+            std::cout << std::format("Usage: {} [--cycles N] [--core=interpreter|jit|lockstep] [--run-ahead N] [--frontend] [--json] [ROM...]\n", argv[0]);
+            return 1;
+        } else {
+            workloads.push_back({argument, argument, {}});
+        }
+    }
+
+    if((ahead > 0 || frontend) && core == Core::LOCKSTEP) {
+        std::cerr << "lockstep: runs no frontend and cannot run ahead\n";
+        return 1;
+    }
+    if(ahead > 0 || frontend) workloads.push_back(paced);
+
+    std::vector<Result> results;
+    for(const auto& workload : workloads) {
+        results.push_back((core == Core::LOCKSTEP) ? measure_lockstep(workload, cycles) : measure(workload, cycles, core, ahead, frontend));
+    }
+
+    const auto core_name = (core == Core::LOCKSTEP) ? "lockstep" : (core == Core::JIT) ? "jit" : "interpreter";
+    auto allocated = false;
+    uint64_t dropped = 0;
+    if(json) std::cout << std::format("{{\"core\": \"{}\", \"cycles\": {}, \"cycles_per_frame\": {}, \"instances\": {}, \"results\": [\n", core_name, cycles, CYCLES_PER_TICK, (core == Core::LOCKSTEP) ? LANES : 1);
+    for(size_t index = 0; index < results.size(); index++) {
+        const auto& result = results[index];
+        const auto instructions_per_second = result.instructions / result.seconds;
+        const auto mips = instructions_per_second / 1e6;
+        const auto nanoseconds = result.seconds * 1e9 / result.instructions;
+        const auto frames_per_second = instructions_per_second / CYCLES_PER_TICK;
+        allocated |= (result.allocated > 0);
+        dropped += result.dropped;
+
+        if(json) {
+            const auto separator = (index + 1 < results.size()) ? "," : "";
+            std::cout << std::format("    {{\"name\": \"{}\", \"seconds\": {:.6f}, \"mips\": {:.2f}, \"ns_per_instruction\": {:.3f}, \"frames_per_second\": {:.0f}, \"allocations\": {}}}{}\n",
+                escape(result.name), result.seconds, mips, nanoseconds, frames_per_second, result.allocated, separator);
+        } else {
+            std::cout << std::format("{} ({}): {} instructions in {:.3f}s, {:.1f} MIPS, {:.2f} ns/instruction, {:.0f} frames/s, {} allocations\n",
+                result.name, core_name, result.instructions, result.seconds, mips, nanoseconds, frames_per_second, result.allocated);
+        }
+    }
+    if(json) std::cout << "]}\n";
+
+    // Steady-state frames must not touch the heap, and every frame run-ahead hands over must reach the screen
+    if(dropped > 0) std::cerr << std::format("run-ahead: {} frames handed over clean would not have been presented\n", dropped);
+    return (allocated || dropped > 0) ? 2 : 0;
+}
+
+Result measure(const Workload& workload, const uint64_t cycles, const Core core, const uint32_t ahead, const bool frontend) {
+    auto processor = std::make_unique<CPU>();
+    processor->init(SEED);
+    processor->load(read_workload(workload));
+
+    std::unique_ptr<JIT> recompiler;
+    if(core == Core::JIT) recompiler = std::make_unique<JIT>(*processor);
+
+    std::unique_ptr<Frontend> window;
+    if(frontend) window = std::make_unique<Frontend>();
+    // Stands in for the render thread, which skips the framebuffers handed to it clean, as GPU::draw does
+    auto presented = std::make_unique<TripleBuffer<Framebuffer>>();
+    State present;
+    auto predicted = false;
+    uint64_t dropped = 0;
+    uint64_t index = 0;
+    const auto frame = [&]() {
+        if(window == nullptr) {
+            run_frame(*processor, recompiler.get());
+        } else {
+            // In the order emulate runs them
+            if(index % KEY_PERIOD == 0) window->input.push({index, 0x5, (index / KEY_PERIOD) % 2 == 0});
+            window->input.apply(*processor, index);
+            if(recompiler != nullptr) {
+                recompiler->run(CYCLES_PER_TICK);
+            } else {
+                processor->run(CYCLES_PER_TICK);
+            }
+            window->buzzer.push_frame(*processor);
+            window->buzzer.pop(window->chunk, 0);
+            window->capture.push(processor->get_framebuffer(), index);
+            processor->tick();
+            processor->snapshot(window->state);
+            window->history.push(window->state);
+        }
+        index++;
+
+        auto& framebuffer = processor->get_framebuffer();
+        if(ahead > 0) {
+            predicted = run_ahead(*processor, recompiler.get(), ahead, CYCLES_PER_TICK, present, *presented, predicted);
+        } else if(window != nullptr && framebuffer.is_dirty()) {
+            presented->write(framebuffer);
+            framebuffer.set_clean();
+        }
+        if(const auto* handed = presented->read(); handed != nullptr && !handed->is_dirty()) dropped++;
+    };
+
+    for(uint64_t warmup = 0; warmup < WARMUP_FRAMES; warmup++) frame();
+
+    const auto allocations_before = allocations;
+    const auto start = std::chrono::steady_clock::now();
+    for(uint64_t cycle = 0; cycle < cycles; cycle += CYCLES_PER_TICK) frame();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    // Taken before the name is copied into the result, which may allocate
+    const auto allocated = allocations - allocations_before;
+
+    return {workload.name, elapsed, cycles, allocated, dropped};
+}
+
+Result measure_lockstep(const Workload& workload, const uint64_t cycles) {
+    auto lanes = std::make_unique<Lockstep<LANES>>();
+    lanes->init(SEED);
+    lanes->load(read_workload(workload));
+
+    for(uint64_t frame = 0; frame < WARMUP_FRAMES; frame++) {
+        lanes->run(CYCLES_PER_TICK);
+        lanes->tick();
+    }
+
+    const auto allocations_before = allocations;
+    const auto start = std::chrono::steady_clock::now();
+    for(uint64_t cycle = 0; cycle < cycles; cycle += CYCLES_PER_TICK) {
+        lanes->run(CYCLES_PER_TICK);
+        lanes->tick();
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const auto allocated = allocations - allocations_before;
+
+    return {workload.name, elapsed, cycles * LANES, allocated, 0};
+}
+
+std::vector<uint8_t> read_workload(const Workload& workload) {
+    if(!workload.rom_path.empty()) {
+        const RomImage rom(workload.rom_path);
+        return {rom.bytes().begin(), rom.bytes().end()};
+    }
+
+    std::vector<uint8_t> rom;
+    for(const auto opcode : workload.opcodes) rom.insert(rom.end(), {static_cast<uint8_t>(opcode >> 8), static_cast<uint8_t>(opcode)});
+    return rom;
+}
+
+void run_frame(CPU& processor, JIT* recompiler) {
+    if(recompiler != nullptr) {
+        recompiler->run(CYCLES_PER_TICK);
+    } else {
+        processor.run(CYCLES_PER_TICK);
+    }
+    processor.tick();
+}
+
+std::string escape(const std::string& text) {
+    std::string escaped;
+    for(const auto character : text) {
+        if(character == '"' || character == '\\') escaped.push_back('\\');
+        escaped.push_back(character);
+    }
+    return escaped;
+}
+
+#undef DEFAULT_CYCLES
+#undef CYCLES_PER_TICK
+#undef WARMUP_FRAMES
+#undef SEED
+#undef LANES
+#undef REWIND_CAPACITY
+#undef KEY_PERIOD
+#undef CAPTURE_SINK
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <SFML/Audio/SoundStream.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "buzzer.h"
+#include "octopus.h"
+
+// \brief Plays the buzzer through a stream SFML pulls from on a thread of its own. The emulation thread synthesizes each frame's samples into the Buzzer's ring, which the stream drains, so neither waits for the other, and a stream that finds the ring dry plays silence instead of starving
+struct Audio : sf::SoundStream {
+    // \brief Samples handed to SFML at a time. It queues a few of them, which along with the ring is all the latency there is
+    private: static constexpr size_t CHUNK_SIZE = 192;
+    // \brief Samples the ring is left with at most before a chunk is taken. Frames arrive whole, so a frame and a chunk are needed not to run dry, anything past that is latency left over from frames run back to back
+    private: static constexpr size_t MAX_BUFFERED = Buzzer::SAMPLES_PER_FRAME + CHUNK_SIZE;
+
+    private: Buzzer buzzer;
+    // \brief The chunk SFML is playing, owned by its thread
+    private: int16_t chunk[CHUNK_SIZE];
+
+    public: Audio();
+    // \brief Stops the stream, which would otherwise keep pulling from a destroyed ring
+    public: ~Audio();
+    // \brief Synthesizes one frame of the provided CPU's buzzer, see Buzzer::push_frame. Called by the emulation thread only
+    public: void push_frame(const CPU&);
+
+    // \brief Hands SFML the next chunk, topped up with silence if the ring ran dry
+    private: bool onGetData(sf::SoundStream::Chunk&) override;
+    // \brief Does nothing, the buzzer being live
+    private: void onSeek(sf::Time) override;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "octopus.h"
+
+// \brief One headless run of a ROM for a fixed amount of instruction cycles
+struct Job {
+    std::string rom_path;
+    uint64_t cycles;
+    uint64_t seed;
+};
+
+struct JobResult {
+    uint64_t framebuffer_hash;
+    // \brief Cycles run before the job finished or faulted, not counting the faulting instruction
+    uint64_t cycles;
+    // \brief Why the job stopped early, or empty if it ran all of its cycles
+    std::string fault;
+};
+
+struct BatchOptions {
+    size_t threads;
+    uint32_t instructions_per_frame;
+    // \brief Runs every job on the recompiling core instead of the interpreter
+    bool jit;
+    // \brief The quirks every job runs with
+    Profile profile;
+};
+
+// \brief Parses a jobs file. Each line holds a ROM path, a cycle count and optionally a seed, which defaults to the provided one. Blank lines and lines starting with '#' are skipped
+std::vector<Job> read_jobs(const std::string, const uint64_t);
+// \brief Runs every job on its own CPU across a pool of threads that steal queued jobs from each other once theirs run out. Results are in the order of the jobs
+std::vector<JobResult> run_batch(const std::vector<Job>&, const BatchOptions&);
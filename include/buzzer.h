@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#include "octopus.h"
+#include "scheduler.h"
+#include "sync.h"
+
+// \brief Synthesizes the buzzer, a square wave or the ROM's XO-CHIP pattern at its pitch while the sound timer is set, into a ring another thread drains. Knows nothing of the audio device, which is Audio's part
+struct Buzzer {
+    public: static constexpr uint32_t SAMPLE_RATE = 48000;
+    public: static constexpr size_t SAMPLES_PER_FRAME = SAMPLE_RATE / Scheduler::FRAME_RATE;
+    private: static constexpr size_t RING_SIZE = 2048;
+
+    private: SpscQueue<int16_t, RING_SIZE> samples;
+    // \brief The frame being synthesized, owned by the emulation thread
+    private: int16_t frame[SAMPLES_PER_FRAME];
+    // \brief Position in the pattern, in pattern samples, owned by the emulation thread
+    private: double phase;
+
+    public: Buzzer();
+    // \brief Synthesizes one frame of the provided CPU's buzzer into the ring, dropping what does not fit. Called by the emulation thread only, once per frame run
+    public: void push_frame(const CPU&);
+    // \brief Drops the oldest samples past the provided amount, then takes as many as fit into the provided span, returning how many. Called by the draining thread only
+    public: size_t pop(const std::span<int16_t>, const size_t);
+};
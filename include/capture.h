@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "delta.h"
+#include "octopus.h"
+#include "sync.h"
+
+// \brief The pixels of a frame, rows of Framebuffer::WIDTH / 8 bytes with the leftmost pixel in the most significant bit. Low resolution only fills the top left corner, leaving the rest off
+using FrameImage = std::array<uint8_t, Framebuffer::WIDTH / 8 * Framebuffer::HEIGHT>;
+
+// \brief Streams the framebuffer as it changes, to a file or to a viewer over TCP. Each frame whose pixels changed becomes a record of how many frames passed since the last one, the resolution and the XOR of its pixels against the last frame sent, encoded by encode_delta, which usually takes a few bytes
+struct Capture {
+    // \brief Bytes the emulation thread can get ahead of a viewer by, many frames' worth of records
+    private: static constexpr size_t SEND_QUEUE_SIZE = 1 << 16;
+
+    private: std::ofstream file;
+    // \brief The socket a viewer is reached through, or -1 when writing to this->file or once the viewer went away. Owned by this->sender while it runs
+    private: int connection;
+    // \brief The records waiting for this->sender to write them to the viewer, so a slow viewer never holds back the emulation thread
+    private: SpscQueue<uint8_t, SEND_QUEUE_SIZE> outgoing;
+    // \brief Bumped after every push to this->outgoing and once more when stopping, which this->sender sleeps on
+    private: std::atomic<uint32_t> pushed;
+    private: std::atomic<bool> stopping;
+    private: std::thread sender;
+    // \brief The pixels and the resolution of the frame sent last
+    private: FrameImage previous;
+    private: bool hires;
+    // \brief The frame sent last, which the next record counts from
+    private: uint64_t frame;
+    // \brief The pixels of the frame being sent
+    private: FrameImage image;
+    // \brief The record being sent, large enough for the worst case
+    private: std::string record;
+
+    // \brief Opens the provided destination, a file or "tcp://HOST:PORT" for a viewer listening there, and writes the capture's header. Throws if it cannot be opened
+    public: Capture(const std::string);
+    public: ~Capture();
+    public: Capture(const Capture&) = delete;
+    public: Capture& operator=(const Capture&) = delete;
+
+    // \brief Sends a record of the provided framebuffer, drawn in the provided frame, if it is dirty and its pixels differ from the last ones sent. Frames must be pushed in order
+    public: void push(const Framebuffer&, const uint64_t);
+
+    // \brief Writes the provided bytes to the file, or queues them for the viewer whole. Returns false, writing nothing, if the viewer fell too far behind for them to fit
+    private: bool send(const uint8_t*, const size_t);
+    // \brief The loop of this->sender, writing the queued bytes to the viewer until stopping. A viewer that cannot be written to anymore ends the stream, not the emulation
+    private: void stream();
+};
+
+// \brief A frame of a capture, as read back by read_capture
+struct CapturedFrame {
+    // \brief The frame it was drawn in, counted from the first one the capture saw
+    uint64_t frame;
+    bool hires;
+    FrameImage image;
+};
+
+// \brief Reads every frame of a capture written by Capture from file_path, throwing if it is not a valid capture
+std::vector<CapturedFrame> read_capture(const std::string);
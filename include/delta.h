@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// \brief The most bytes encode_delta writes for buffers of the provided size, when every other run of them changed
+constexpr size_t max_delta_size(const size_t size) {
+    return size + 8;
+}
+
+// \brief Writes the XOR of the provided buffers, of the provided size, into the provided output as a list of runs, each made of an amount of unchanged bytes, an amount of changed bytes, both 16-bit little-endian, and the XOR of the changed bytes. Returns its length, at most max_delta_size of the size. Buffers that barely changed take a few bytes
+size_t encode_delta(const uint8_t*, const uint8_t*, const size_t, uint8_t*);
+// \brief XORs the provided delta of the provided length, as written by encode_delta, into the provided buffer of the provided size. Returns false, leaving the buffer partly updated, if the delta is malformed or reaches past the buffer
+bool decode_delta(const uint8_t*, const size_t, uint8_t*, const size_t);
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// \brief Returns the provided opcode in the mnemonics of Cowgod's technical reference, e.g. "DRW V0, V1, 5"
+std::string disassemble(const uint16_t);
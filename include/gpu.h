@@ -0,0 +1,51 @@
+#pragma once
+
+#include <SFML/Graphics/RenderWindow.hpp>
+#include <SFML/Graphics.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "octopus.h"
+
+struct GPU {
+    // \brief Framebuffer pixels per texel of this->bits, 8 in each RGBA channel
+    private: static constexpr uint8_t PIXELS_PER_TEXEL = 32;
+
+    private: sf::RenderWindow active_screen;
+    // \brief The framebuffer as uploaded, the bytes of each row's words in big-endian order so the leftmost pixel is the most significant bit of the first channel. Only the rows and words of the current resolution are filled in
+    private: std::array<uint8_t, Framebuffer::WIDTH / 8 * Framebuffer::HEIGHT> packed;
+    // \brief this->packed on the GPU, Framebuffer::WIDTH / PIXELS_PER_TEXEL texels wide, of which only the top left corner is used in low resolution
+    private: sf::Texture bits;
+    // \brief Covers this->history with this->bits, for this->expand to run over every pixel of the screen
+    private: sf::Sprite drawable_bits;
+    // \brief Expands this->bits into colors, blended with the previous screen if the phosphors persist
+    private: sf::Shader expand;
+    // \brief The last two screens, at high resolution, each drawn from the other by this->expand
+    private: sf::RenderTexture history[2];
+    // \brief The index in this->history of the screen being shown
+    private: size_t current;
+    // \brief this->history[this->current], scaled to fit the window
+    private: sf::Sprite drawable_graphics;
+    // \brief The resolution of the framebuffer last uploaded
+    private: sf::Vector2f resolution;
+    // \brief Whether pixels turned off fade out over a few frames instead of at once, hiding the flicker of ROMs that erase and redraw their sprites
+    private: bool phosphor;
+    // \brief Frames left until the pixels last turned off have faded out
+    private: uint8_t fading;
+
+    // \brief Initializes GPU's attributes and creates a resizable screen, with persistent phosphors if the provided value is true
+    public: sf::RenderWindow& init(const bool);
+    // \brief If the provided framebuffer is dirty, uploads its pixels into this->bits, expands them into the next screen, redraws and marks it clean
+    public: void draw(Framebuffer&);
+    // \brief Expands the last framebuffer uploaded again if pixels turned off are still fading out and redraws, for the frames nothing was drawn in. Returns whether they were
+    public: bool fade();
+    // \brief Scales the screen to the largest size that fits the provided window size, keeping its aspect ratio, and redraws
+    public: void resize(const uint32_t, const uint32_t);
+    // \brief Draws the current screen to this->active_screen again, for when the window lost its contents
+    public: void redraw();
+
+    // \brief Expands this->bits into the next screen of this->history, blending in the provided fraction of the previous one where pixels are off
+    private: void render(const float);
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "octopus.h"
+
+// \brief A CHIP-8 key pressed or released at the start of a frame
+struct KeyEvent {
+    // \brief The frame the event applies before, counted from the first one
+    uint64_t frame;
+    uint8_t key;
+    bool pressed;
+};
+
+// \brief Key events waiting for the frame boundary they apply at. Interactive play and replayed input both go through it, so a CPU only ever sees keys change between frames
+struct InputQueue {
+    private: std::vector<KeyEvent> events;
+    // \brief Index into this->events of the first event not applied yet
+    private: size_t next = 0;
+
+    // \brief Queues the provided event. Events must be pushed in frame order, and events for frames already started apply at the next boundary
+    public: void push(const KeyEvent&);
+    // \brief Applies every queued event stamped at or before the provided frame to the CPU
+    public: void apply(CPU&, const uint64_t);
+    // \brief Returns whether every queued event was applied
+    public: bool empty() const;
+};
+
+// \brief Parses an input file into the provided queue. Each line holds a frame, a key in hex and "down" or "up", blank lines and lines starting with '#' are skipped
+void read_input(const std::string, InputQueue&);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "octopus.h"
+
+// \brief A recompiling core for a CPU. Translates basic blocks starting at the CPU's program counter into host code and chains them together. Instructions it cannot translate (DRW, CLS, key waits, calls, memory stores and such) run on the CPU's interpreter, and writes over translated code flush every block
+struct JIT {
+    // \brief A block exit that jumps to a constant target, patched to jump straight into the target's block once that is translated
+    private: struct Exit {
+        uint16_t target;
+        uint32_t offset;
+    };
+
+    private: CPU& cpu;
+
+    // \brief Executable memory the blocks are emitted into
+    private: uint8_t* code;
+    private: size_t code_used;
+
+    // \brief Offset of the block translated for each address into this->code, or a negative marker
+    private: int32_t blocks[4096];
+    // \brief Whether each byte of the CPU's ram was read to translate some block
+    private: bool covered[4096];
+    // \brief Exits whose target was not translated yet
+    private: std::vector<Exit> exits;
+
+    // \brief Maps executable memory for the blocks. Falls back to the interpreter if the host is not supported
+    public: JIT(CPU&);
+    public: ~JIT();
+    public: JIT(const JIT&) = delete;
+    public: JIT& operator=(const JIT&) = delete;
+
+    // \brief Returns whether the host can run translated code
+    public: static bool supported();
+    // \brief Drops every translated block. Must be called if the CPU's ram is changed from outside the JIT
+    public: void flush();
+    // \brief Restores the provided state into the CPU like CPU::restore, flushing translated code only if that changes a byte of ram some block was translated from
+    public: void restore(const State&);
+    // \brief Emulates exactly the provided amount of instruction cycles, producing the same state the CPU's interpreter would, fault and cycles run included
+    public: FaultStatus run(uint64_t);
+
+    // \brief Executes a single instruction on the interpreter, flushing translated code if it wrote over it
+    private: void interpret();
+    // \brief Translates the basic block that starts at the provided address, returning its offset into this->code or a negative marker
+    private: int32_t translate(const uint16_t);
+    // \brief Makes this->code writable or executable
+    private: void protect(const bool);
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include "octopus.h"
+
+// \brief Runs N instances of one ROM side by side, one instruction each per cycle, for workloads that try many inputs on the same program. Registers are kept as structure of arrays, so the instances sitting at the same address execute ALU operations, loads, skips and timer reads together as one pass over every lane, which the compiler turns into vector code. Everything else, and instances that diverged, run on each instance's own CPU with the interpreter's semantics
+template<size_t N>
+struct Lockstep {
+    static_assert(N > 0 && N <= 64, "lanes are tracked in a 64-bit mask");
+
+    // \brief The mask with a bit set for every lane
+    private: static constexpr uint64_t ALL = (N == 64) ? ~uint64_t{0} : (uint64_t{1} << N) - 1;
+
+    // \brief Every register, one bit per register, as taken by this->store and this->reload
+    private: static constexpr uint16_t ALL_REGISTERS = 0xffff;
+
+    // \brief The registers of every lane, this->v[x][lane] being Vx of that lane, so a register of all lanes is contiguous
+    private: alignas(64) uint8_t v[16][N];
+    // \brief The index register of every lane
+    private: alignas(64) uint16_t i[N];
+    // \brief The program counter of every lane
+    private: alignas(64) uint16_t pc[N];
+    // \brief The delay timer of every lane
+    private: alignas(64) uint8_t dt[N];
+    // \brief The keypad of every lane, gathered from their CPUs when this->run starts since keys only change between calls
+    private: alignas(64) uint16_t keys[N];
+    // \brief 0xff for the lanes taking part in the operation being executed and 0 for the others, so results can be blended in without branches
+    private: alignas(64) uint8_t active[N];
+    // \brief Same as this->active, for the 16-bit registers
+    private: alignas(64) uint16_t active_wide[N];
+
+    // \brief The rest of each lane's state. Their registers and delay timer are only up to date after this->store, which copies only the ones an instruction run on its own needs
+    private: std::unique_ptr<CPU[]> lanes;
+    // \brief The addresses of ram any lane wrote to, the only ones where lanes may hold different code
+    private: std::bitset<4096> written;
+    // \brief Lanes blocked on FX0A, which stay blocked until this->run returns since keys cannot change before
+    private: uint64_t blocked;
+    // \brief Lanes that faulted and stopped
+    private: uint64_t faulted;
+    // \brief The quirks of every lane's profile. Checked once per group of lanes rather than once per lane, which keeps them out of the vector loops
+    private: Quirks quirks;
+    // \brief Whether every running lane is known to be at the same address, sparing a comparison of every program counter
+    private: bool converged;
+
+    public: Lockstep();
+
+    // \brief Initializes every lane like CPU::init, Profile::REFERENCE included, lane n seeded with the provided seed plus n
+    public: void init(const uint64_t);
+    // \brief Sets the quirks of every lane like CPU::set_profile
+    public: void set_profile(const Profile);
+    // \brief Copies the provided ROM into every lane's ram like CPU::load
+    public: void load(const std::span<const uint8_t>);
+    // \brief Presses or releases the provided key of the provided lane
+    public: void set_key(const size_t, const uint8_t, const bool);
+    // \brief Emulates the provided amount of instruction cycles on every lane that did not fault, leaving each in the state a CPU running them would
+    public: void run(uint64_t);
+    // \brief Decrements the timers of every lane that did not fault, like CPU::tick
+    public: void tick();
+    // \brief Returns the CPU of the provided lane, its registers brought up to date
+    public: const CPU& get_lane(const size_t);
+    // \brief Returns why and where the provided lane stopped, with Fault::NONE if it did not
+    public: const FaultStatus& get_fault(const size_t) const;
+
+    // \brief Emulates one instruction cycle on each of the provided lanes, grouping the ones at the same address running the same opcode
+    private: void step(const uint64_t);
+    // \brief Executes the provided instruction, found at the provided address, on every lane in this->active or on all of them unless MASKED. Returns false, changing nothing, if it is one that has to run on each lane's CPU instead
+    private: template<bool MASKED> bool execute(const Instruction&, const uint16_t);
+    // \brief Executes the provided DRW on each lane in the provided mask straight from the lanes' registers, sparing the copies into their CPUs that would dominate sprite-heavy ROMs
+    private: void draw(const Instruction&, const uint64_t);
+    // \brief Executes the provided FX55 on each lane in the provided mask straight from the lanes' registers, for the same reason
+    private: void store_registers(const Instruction&, const uint64_t);
+    // \brief Executes the provided FX65 on each lane in the provided mask straight into the lanes' registers, for the same reason
+    private: void load_registers(const Instruction&, const uint64_t);
+    // \brief Executes the next instruction of the provided lane on its CPU, which it reads and writes the provided registers of
+    private: void execute_lane(const size_t, const uint16_t);
+    // \brief Returns the opcode at the provided address of the provided lane's ram
+    private: uint16_t opcode_at(const size_t, const uint16_t) const;
+    // \brief Copies the provided registers, one bit per register, I, the program counter and the delay timer of the provided lane into its CPU
+    private: void store(const size_t, const uint16_t);
+    // \brief Copies the provided registers, I, the program counter and the delay timer of the provided lane's CPU back into the lanes
+    private: void reload(const size_t, const uint16_t);
+};
@@ -1,58 +1,305 @@
 #pragma once
 
-#include <SFML/Graphics/RenderWindow.hpp>
-#include <stack>
-#include <SFML/Graphics.hpp>
-
-struct GPU {
-    private: sf::RenderWindow active_screen;
-    private: sf::Image framebuffer;
-    private: sf::Texture graphics;
-    private: sf::Sprite drawable_graphics;
-    
-    // \brief Initializes GPU's attributes and creates a screen
-    public: sf::RenderWindow& init();
-    // \brief Draws the collection of bits that represent a sprite in this->framebuffer, starting at default_x and default_y
-    public: uint8_t copy_to_framebuffer(const uint8_t, const uint8_t, const std::vector<uint8_t>);
-    // \brief Fills this->framebuffer with OFF_COLOR pixels, effectively cleaning it up
-    public: void clear_framebuffer();
-    // \brief Updates this->graphics texture and draws the new this->drawable_graphics to this->active_screen
-    public: void draw();
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+struct Framebuffer {
+    // \brief The size of the screen in high resolution, SUPER-CHIP's
+    public: static constexpr uint8_t WIDTH = 128;
+    public: static constexpr uint8_t HEIGHT = 64;
+    // \brief The size of the screen in low resolution, the only one CHIP-8 has
+    public: static constexpr uint8_t LORES_WIDTH = 64;
+    public: static constexpr uint8_t LORES_HEIGHT = 32;
+    // \brief Words per row, enough for WIDTH pixels
+    public: static constexpr uint8_t WORDS = WIDTH / 64;
+
+    // \brief One bit per pixel, row y being this->rows[0][y] followed by this->rows[1][y]. The most significant bit is the leftmost pixel. Split by word rather than by row, so low resolution, which only uses this->rows[0] up to LORES_HEIGHT, keeps its rows contiguous and every scroll is a pass over contiguous words
+    private: uint64_t rows[WORDS][HEIGHT];
+    private: bool hires;
+    // \brief Whether the pixels changed since the last call to this->set_clean
+    private: bool dirty;
+
+    // \brief Turns every pixel off
+    public: void clear();
+    // \brief Switches to high resolution if the provided value is true, or back to low resolution, turning every pixel off
+    public: void set_hires(const bool);
+    public: bool is_hires() const;
+    // \brief Returns the width of the screen in the current resolution
+    public: uint8_t get_width() const;
+    // \brief Returns the height of the screen in the current resolution
+    public: uint8_t get_height() const;
+    // \brief XORs the collection of bits that represent a sprite into the pixels, starting at default_x and default_y. Rows are one byte, or two if the provided value is true for 16 pixel wide sprites. Pixels past the edges wrap around to the other side, or are cut off if CLIP. Returns 1 if any pixel was turned off
+    public: template<bool CLIP> uint8_t draw_sprite(const uint8_t, const uint8_t, const std::span<const uint8_t>, const bool);
+    // \brief Moves every pixel down by the provided amount of rows, turning the rows scrolled in off
+    public: void scroll_down(const uint8_t);
+    // \brief Moves every pixel 4 columns to the right, turning the columns scrolled in off
+    public: void scroll_right();
+    // \brief Moves every pixel 4 columns to the left, turning the columns scrolled in off
+    public: void scroll_left();
+    // \brief Returns whether the pixel at x and y, in the current resolution, is on
+    public: bool get_pixel(const uint8_t, const uint8_t) const;
+    // \brief Returns the provided word of row y, 64 pixels with the leftmost in the most significant bit, for consumers that take the pixels packed
+    public: uint64_t get_word(const uint8_t, const uint8_t) const;
+    // \brief Returns whether DRW or CLS changed the pixels since the last call to this->set_clean
+    public: bool is_dirty() const;
+    // \brief Marks the current pixels as presented
+    public: void set_clean();
+    // \brief Marks the current pixels as not presented yet, e.g. after they were replaced by a restored state
+    public: void set_dirty();
+    // \brief Returns a FNV-1a hash of the pixels, useful to compare the output of headless runs
+    public: uint64_t hash() const;
+    // \brief Returns whether the provided bytes, copied from elsewhere into a Framebuffer, hold only 0 or 1 in its bool members, which would be undefined behavior to read otherwise
+    public: static bool is_valid(const uint8_t*);
 };
 
-struct CPU {
-    private: GPU& gpu;
+// \brief A xorshift64* generator. Small and trivially copyable, so it can live in State and be saved and restored with it
+struct Random {
+    private: uint64_t value;
 
-    private: uint8_t ram[4096];
-    private: std::stack<uint16_t> stack;
+    // \brief Derives the generator's state from the provided seed. Equal seeds produce equal sequences
+    public: void seed(const uint64_t);
+    // \brief Advances the generator and returns its next 8 random bits
+    public: uint8_t next_byte();
+};
+
+// \brief The operations an opcode decodes to, in the order of CPU::handlers
+enum class Operation : uint8_t {
+    UNDECODED, SYS, CLS, RET, SCD, SCR, SCL, LOW, HIGH, JP, CALL,
+    SE_BYTE, SNE_BYTE, SE_REGISTER, LD_BYTE, ADD_BYTE,
+    LD_REGISTER, OR, AND, XOR, ADD_REGISTER, SUB, SHR, SUBN, SHL,
+    SNE_REGISTER, LD_I, JP_V0, RND, DRW, SKP, SKNP,
+    LD_VX_DT, LD_VX_K, LD_DT_VX, LD_ST_VX, ADD_I, LD_F, LD_B, LD_MEMORY_VX, LD_VX_MEMORY,
+    LD_AUDIO, LD_PITCH, UNKNOWN, COUNT
+};
+
+// \brief Why a CPU stopped executing instructions. A faulted CPU stays stopped until it is initialized or restored
+enum class Fault : uint8_t {
+    NONE, UNKNOWN_OPCODE, STACK_UNDERFLOW, STACK_OVERFLOW, OUT_OF_BOUNDS
+};
+
+// \brief Returns a short description of the provided fault
+const char* describe(const Fault);
+
+// \brief What stopped a CPU and where, as returned by CPU::cycle and CPU::run
+struct FaultStatus {
+    // \brief Fault::NONE if the CPU did not stop
+    Fault fault;
+    // \brief Address of the faulting instruction
+    uint16_t pc;
+    uint16_t opcode;
+    // \brief Instruction cycles the CPU::run or JIT::run call that returned it executed, not counting a faulting instruction. 0 anywhere else
+    uint64_t cycles = 0;
+};
+
+// \brief Behaviors that differ between CHIP-8 interpreters. Taken as a template parameter by the CPU's execution loop, so each set gets its own build of it with no branches on them
+struct Quirks {
+    // \brief 8XY6 and 8XYE shift Vy into Vx, instead of shifting Vx in place
+    bool shift_vy;
+    // \brief FX55 and FX65 leave I past the last register they stored or loaded
+    bool increment_i;
+    // \brief DRW cuts sprites off at the edges of the screen, instead of wrapping them around
+    bool clip;
+    // \brief BNNN jumps to NNN plus Vx, x being the highest nibble of NNN, instead of V0
+    bool jump_vx;
+    // \brief 00CN, 00FB, 00FC, 00FE and 00FF scroll and switch resolution, and DXY0 draws 16x16 sprites, as on SUPER-CHIP. Otherwise they do nothing
+    bool extended;
+    // \brief F002 loads a 16-byte audio pattern from I and FX3A sets the pitch it plays at, as on XO-CHIP. Otherwise they are unknown opcodes
+    bool audio;
+};
+
+// \brief The sets of quirks ROMs are written for, kept to a few as each is a build of the execution loop
+enum class Profile : uint8_t {
+    // \brief The technical reference's semantics, which this emulator always had
+    REFERENCE,
+    // \brief The COSMAC VIP's original interpreter
+    CHIP8,
+    SCHIP,
+    XOCHIP,
+    COUNT
+};
+
+// \brief The quirks of each Profile, indexed by it
+inline constexpr Quirks profiles[] = {
+    {false, false, false, false, false, false}, // REFERENCE
+    {true, true, true, false, false, false},    // CHIP8
+    {false, false, true, true, true, false},    // SCHIP
+    {true, true, false, false, true, true},     // XOCHIP
+};
+
+// \brief Returns the name of the provided profile, as taken by parse_profile
+const char* describe(const Profile);
+// \brief Sets the provided profile to the one with the provided name, e.g. "schip". Returns false, changing nothing, if there is none
+bool parse_profile(const std::string&, Profile&);
+
+// \brief An opcode split into its operation and operands, as cached by CPU::decoded
+struct Instruction {
+    Operation operation;
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t nn;
+    uint16_t nnn;
+};
+
+// \brief Everything a CPU needs to resume execution. Kept trivially copyable, so it can be reset, copied and compared as a plain block of memory
+struct State {
+    Framebuffer framebuffer;
+
+    uint8_t ram[4096];
+    // \brief Return addresses of the active subroutine calls, this->stack[this->sp - 1] being the innermost
+    uint16_t stack[16];
+    // \brief The stack pointer, the amount of entries in this->stack
+    uint8_t sp;
 
     // \brief The chip's registers
-    private: uint8_t v[16];
+    uint8_t v[16];
     // \brief The program counter register
-    private: uint16_t pc;
+    uint16_t pc;
     // \brief The index register 
-    private: uint16_t i;
+    uint16_t i;
 
     // \brief The delay timer
-    private: uint8_t dt;
+    uint8_t dt;
     // \brief The sound timer
-    private: uint8_t st;
+    uint8_t st;
+
+    bool blocked;
+    // \brief The keypad, one bit per key. Bit n is set while key n is pressed
+    uint16_t keys;
+
+    // \brief The generator behind RND, so a restored state draws the same numbers it would have drawn
+    Random random;
 
-    private: bool blocked;
-    public: std::map<uint8_t, uint8_t> keys;
+    // \brief The audio pattern the buzzer plays in a loop while the sound timer is set, 128 1-bit samples with the first in the most significant bit. Kept after everything execution depends on, see CPU::hash
+    uint8_t pattern[16];
+    // \brief The pitch register. The pattern plays at 4000 * 2^((pitch - 64) / 48) samples per second
+    uint8_t pitch;
+};
+
+struct CPU {
+    friend struct JIT;
+    template<size_t> friend struct Lockstep;
+
+    private: using Handler = void (CPU::*)(const Instruction&);
 
-    // \brief Sets the intern this->gpu reference to the provided GPU
-    public: CPU(GPU& graphics_handler) : gpu(graphics_handler) {};
-    // \brief Initializes CPU's attributes
-    public: void init();
-    // \brief Fills this->ram with bytes from the ROM specified at rom_path
+    private: State state;
+    // \brief Why and where the CPU stopped, Fault::NONE while it runs. Kept out of this->state, as a fault is not something to save or resume from
+    private: FaultStatus fault;
+    // \brief Which build of the loop this->cycle and this->run execute. Kept out of this->state, as it belongs to the ROM rather than to a point of its execution
+    private: Profile profile;
+    // \brief The decoded instruction starting at each address of this->state.ram. Entries with Operation::UNDECODED are decoded on their next fetch
+    private: Instruction decoded[4096];
+
+    // \brief Initializes CPU's attributes, with Profile::REFERENCE. RND draws from a generator seeded with the provided value, so runs with equal seeds and input are reproducible
+    public: void init(const uint64_t);
+    // \brief Fills this->state.ram with bytes from the ROM specified at rom_path, throwing if it does not fit. "-" reads the ROM from stdin
     public: void dump_into_memory(const std::string);
-    // \brief Returns the current opcode that this->pc points to
+    // \brief Copies the provided ROM into this->state.ram at the programs offset, throwing if it does not fit
+    public: void load(const std::span<const uint8_t>);
+    // \brief Returns the in-memory framebuffer that DRW and CLS write to
+    public: Framebuffer& get_framebuffer();
+    public: const Framebuffer& get_framebuffer() const;
+    // \brief Presses or releases the provided key
+    public: void set_key(const uint8_t, const bool);
+    // \brief Returns the keypad, one bit per key like State::keys
+    public: uint16_t get_keys() const;
+    // \brief Returns a FNV-1a hash of the whole machine state, except for whether the framebuffer was presented and the audio, which no instruction reads back, useful to check that two runs ended up in the same state
+    public: uint64_t hash() const;
+    // \brief Returns the sound timer. The buzzer plays while it is not zero
+    public: uint8_t get_sound_timer() const;
+    // \brief Returns the audio pattern the buzzer plays, see State::pattern
+    public: std::span<const uint8_t, 16> get_pattern() const;
+    // \brief Returns the pitch register, see State::pitch
+    public: uint8_t get_pitch() const;
+    // \brief Returns why and where the CPU stopped, with Fault::NONE if it did not. this->state.pc is left at the faulting instruction
+    public: const FaultStatus& get_fault() const;
+    // \brief Sets the quirks instructions execute with. A JIT running this CPU must be flushed afterwards
+    public: void set_profile(const Profile);
+    public: Profile get_profile() const;
+    // \brief Returns whether the CPU is blocked on FX0A with both timers stopped, in which case nothing changes until a key is pressed
+    public: bool is_waiting_for_key() const;
+    // \brief Copies the whole machine state, framebuffer included, into the provided State
+    public: void snapshot(State&) const;
+    // \brief Replaces the whole machine state with the provided one, clearing any fault, and drops the decode cache. A JIT running this CPU must be flushed afterwards
+    public: void restore(const State&);
+    // \brief Returns whether the provided amount of bytes starting at this->state.i lies within this->state.ram
+    private: bool in_bounds(const size_t) const;
+    // \brief Returns whether the provided key is pressed. Values above 0xf are never pressed
+    private: bool is_pressed(const uint8_t) const;
+    // \brief Returns the opcode that this->state.pc points to
     private: uint16_t fetch_opcode();
-    // \brief Evaluates the provided opcode
-    private: void execute(uint16_t);
-    // \brief Emulates an instruction cycle. Gets a opcode from this->fetch_opcode to supply to this->execute
-    public: void cycle();
-    // \brief Designed to execute on every clock tick. Decrements this->dt and this->st
+    // \brief Returns the decoded instruction at this->state.pc, decoding it first if needed, and advances this->state.pc past it
+    private: Instruction fetch_instruction();
+    // \brief Stops the CPU with the provided fault, moving this->state.pc back to the instruction being executed
+    private: void halt(const Fault);
+    // \brief Splits the provided opcode into an Instruction
+    public: static Instruction decode(const uint16_t);
+    // \brief Returns how many of the provided remaining cycles can be skipped because the CPU sits in a loop that cannot end before the next tick: blocked on FX0A, or polling DT through FX07, 3X00 and a 1NNN back to the FX07 while DT is not zero. Skipping them leaves the same state running them would
+    private: uint64_t idle_cycles(const uint64_t) const;
+    // \brief Marks the decoded entries that overlap the provided range of this->state.ram as undecoded. Must be called after every write to it
+    private: void invalidate(const uint16_t, const size_t);
+
+    // \brief The handler of each Operation for the provided quirks, indexed by it
+    private: template<Quirks> static const Handler handlers[];
+
+    private: void op_sys(const Instruction&);
+    private: void op_cls(const Instruction&);
+    private: void op_ret(const Instruction&);
+    private: template<Quirks> void op_scd(const Instruction&);
+    private: template<Quirks> void op_scr(const Instruction&);
+    private: template<Quirks> void op_scl(const Instruction&);
+    private: template<Quirks> void op_low(const Instruction&);
+    private: template<Quirks> void op_high(const Instruction&);
+    private: void op_jp(const Instruction&);
+    private: void op_call(const Instruction&);
+    private: void op_se_byte(const Instruction&);
+    private: void op_sne_byte(const Instruction&);
+    private: void op_se_register(const Instruction&);
+    private: void op_ld_byte(const Instruction&);
+    private: void op_add_byte(const Instruction&);
+    private: void op_ld_register(const Instruction&);
+    private: void op_or(const Instruction&);
+    private: void op_and(const Instruction&);
+    private: void op_xor(const Instruction&);
+    private: void op_add_register(const Instruction&);
+    private: void op_sub(const Instruction&);
+    private: template<Quirks> void op_shr(const Instruction&);
+    private: void op_subn(const Instruction&);
+    private: template<Quirks> void op_shl(const Instruction&);
+    private: void op_sne_register(const Instruction&);
+    private: void op_ld_i(const Instruction&);
+    private: template<Quirks> void op_jp_v0(const Instruction&);
+    private: void op_rnd(const Instruction&);
+    private: template<Quirks> void op_drw(const Instruction&);
+    private: void op_skp(const Instruction&);
+    private: void op_sknp(const Instruction&);
+    private: void op_ld_vx_dt(const Instruction&);
+    private: void op_ld_vx_k(const Instruction&);
+    private: void op_ld_dt_vx(const Instruction&);
+    private: void op_ld_st_vx(const Instruction&);
+    private: void op_add_i(const Instruction&);
+    private: void op_ld_f(const Instruction&);
+    private: void op_ld_b(const Instruction&);
+    private: template<Quirks> void op_ld_memory_vx(const Instruction&);
+    private: template<Quirks> void op_ld_vx_memory(const Instruction&);
+    private: template<Quirks> void op_ld_audio(const Instruction&);
+    private: template<Quirks> void op_ld_pitch(const Instruction&);
+    private: void op_unknown(const Instruction&);
+
+    // \brief Emulates an instruction cycle. Gets an instruction from this->fetch_instruction and dispatches it through this->handlers. Does nothing once the CPU faulted. Returns the fault, if any
+    public: FaultStatus cycle();
+    // \brief Emulates the provided amount of instruction cycles, same as calling this->cycle that many times but with threaded dispatch where the compiler supports it. Returns early if the CPU faults, with the fault, and how many cycles ran either way
+    public: FaultStatus run(uint64_t);
+    // \brief Same as this->run, but also reports every instruction to the provided policy, before and after executing it. Instantiated for the policies in profiler.h and trace.h
+    public: template<typename Policy> FaultStatus run(uint64_t, Policy&);
+    // \brief this->cycle, built for the provided quirks
+    private: template<Quirks> void step();
+    // \brief this->run's loop, built for the provided quirks so none of them is checked while it runs
+    private: template<Quirks, typename Policy> FaultStatus execute(uint64_t, Policy&);
+    // \brief Returns this->fault along with the provided amount of cycles this->run executed
+    private: FaultStatus stopped(const uint64_t) const;
+    // \brief Designed to execute on every clock tick. Decrements this->state.dt and this->state.st
     public: void tick();
 };
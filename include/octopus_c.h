@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A C interface to the emulator, for embedding instances in other languages. Nothing in it throws, allocates behind the caller's back past octo_create or touches a window, and instances share nothing, so separate instances can run on separate threads
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// \brief An emulated machine, opaque to callers
+typedef struct octo_instance octo_instance;
+
+// \brief What octo_run_frames stopped on, matching the core's Fault. OCTO_ERROR is returned for invalid arguments
+enum {
+    OCTO_OK = 0,
+    OCTO_UNKNOWN_OPCODE = 1,
+    OCTO_STACK_UNDERFLOW = 2,
+    OCTO_STACK_OVERFLOW = 3,
+    OCTO_OUT_OF_BOUNDS = 4,
+    OCTO_ERROR = -1
+};
+
+// \brief Returns a new machine with RND seeded with the provided value and the reference quirks, or NULL if it could not be allocated
+octo_instance* octo_create(uint64_t seed);
+// \brief Frees the provided machine. NULL is ignored
+void octo_destroy(octo_instance* instance);
+// \brief Copies the provided ROM into ram at the programs offset. Returns OCTO_ERROR if it does not fit
+int octo_load(octo_instance* instance, const uint8_t* rom, size_t size);
+// \brief Sets the quirks the ROM runs with: "reference", "chip8", "schip" or "xochip". Returns OCTO_ERROR for any other name
+int octo_set_profile(octo_instance* instance, const char* name);
+// \brief Presses the provided key, 0 to 0xf, if pressed is not zero, or releases it. Keys only change between calls to octo_run_frames
+void octo_set_key(octo_instance* instance, uint8_t key, int pressed);
+// \brief Runs the provided amount of 60 Hz frames, each of the provided amount of instruction cycles followed by a timer tick. Returns OCTO_OK, or the fault the machine stopped on, where it stays until restored
+int octo_run_frames(octo_instance* instance, uint32_t frames, uint32_t instructions_per_frame);
+// \brief Returns the pc of the instruction the machine faulted on, or 0 if it did not
+uint16_t octo_fault_address(const octo_instance* instance);
+// \brief Writes the framebuffer into pixels as rows of width / 8 bytes, the leftmost pixel in the most significant bit, and its size in the current resolution into width and height, which may be NULL. Returns the amount of bytes written, or 0 if capacity is too small for them
+size_t octo_framebuffer(const octo_instance* instance, uint8_t* pixels, size_t capacity, uint32_t* width, uint32_t* height);
+// \brief Returns the FNV-1a hash of the framebuffer, the one headless runs print
+uint64_t octo_framebuffer_hash(const octo_instance* instance);
+// \brief Returns the size of the buffers octo_snapshot and octo_restore take
+size_t octo_state_size(void);
+// \brief Copies the whole machine state into the provided buffer of octo_state_size() bytes. Returns OCTO_ERROR if size is not that. Snapshots are only valid for the library build that made them
+int octo_snapshot(const octo_instance* instance, void* buffer, size_t size);
+// \brief Replaces the whole machine state with a snapshot, clearing any fault. Returns OCTO_ERROR, leaving the machine as it was, if size is not octo_state_size() or the buffer does not hold a valid state, such as one with a stack pointer past the stack
+int octo_restore(octo_instance* instance, const void* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "octopus.h"
+
+// \brief Execution-loop policy for CPU::run that records nothing. Its hooks are empty, so the loop compiles to the same code as it would without a policy
+struct NullProfiler {
+    public: void instruction(const State&, const Instruction&) {}
+    public: void retired(const State&, const Instruction&) {}
+};
+
+// \brief Execution-loop policy for CPU::run that counts where a ROM spends its time
+struct Profiler {
+    public: static constexpr size_t MAX_DRAWS = 64;
+    public: static constexpr size_t TOP_ADDRESSES = 20;
+
+    // \brief Executions of each Operation
+    public: uint64_t operations[static_cast<size_t>(Operation::COUNT)] = {};
+    // \brief Executions of the instruction at each address
+    public: uint64_t addresses[4096] = {};
+    // \brief Frames by the amount of DRWs they ran. The last bucket counts every frame with this->MAX_DRAWS or more
+    public: uint64_t draws_per_frame[MAX_DRAWS + 1] = {};
+    public: uint64_t frames = 0;
+    // \brief Host time spent running instructions and presenting frames
+    public: double emulation_seconds = 0;
+    public: double presentation_seconds = 0;
+
+    // \brief DRWs run so far in the current frame
+    private: uint32_t draws = 0;
+
+    // \brief Counts the instruction at the provided state's program counter as executed. Called before executing it
+    public: void instruction(const State& state, const Instruction& instruction) {
+        this->operations[static_cast<size_t>(instruction.operation)]++;
+        this->addresses[state.pc % std::size(this->addresses)]++;
+        if(instruction.operation == Operation::DRW) this->draws++;
+    }
+    public: void retired(const State&, const Instruction&) {}
+
+    // \brief Closes the current frame, adding its DRWs to this->draws_per_frame
+    public: void end_frame();
+    // \brief Writes the counters to file_path as JSON: totals per operation, the DRW histogram, host times, a 64x64 heatmap of this->addresses and a list of the this->TOP_ADDRESSES hottest ones
+    public: void write(const std::string) const;
+};
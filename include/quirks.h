@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "octopus.h"
+
+// \brief Looks the ROM with the provided hash up in the quirks database at file_path, a text file of "HASH PROFILE" lines like "4f7a2c3d9e8b1605 schip", HASH being hash_rom's in hex. Blank lines and lines starting with '#' are skipped. Returns whether the ROM is listed, setting the provided profile to its one if so
+bool find_profile(const std::string, const uint64_t, Profile&);
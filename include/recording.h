@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "input.h"
+#include "octopus.h"
+
+// \brief The keypad as it was from a frame on
+struct KeypadChange {
+    uint64_t frame;
+    // \brief One bit per key, like State::keys
+    uint16_t keys;
+};
+
+// \brief A session reduced to what reproduces it: the ROM, the seed, the pace, the quirks and the keypad at every frame it changed at, plus the hash of the state it ended in
+struct Recording {
+    public: uint64_t rom_hash;
+    public: uint64_t seed;
+    public: uint32_t instructions_per_frame;
+    public: Profile profile;
+    // \brief Frames the session ran for
+    public: uint64_t frames;
+    // \brief CPU::hash after the last frame
+    public: uint64_t state_hash;
+    public: std::vector<KeypadChange> changes;
+
+    // \brief Appends a change if the provided keypad differs from the last one recorded. Called before each frame runs
+    public: void record(const uint64_t, const uint16_t);
+    // \brief Queues the key events that reproduce this->changes
+    public: void queue(InputQueue&) const;
+};
+
+// \brief Writes the provided recording to file_path. Frames are stored as varint deltas from the previous change and fixed-size fields in little-endian, so files are small and portable
+void write_recording(const std::string, const Recording&);
+// \brief Reads a recording written by write_recording from file_path into the provided one
+void read_recording(const std::string, Recording&);
+// \brief Returns a FNV-1a hash of the provided ROM, which a recording keeps to check it replays on the ROM it was made with
+uint64_t hash_rom(const std::span<const uint8_t>);
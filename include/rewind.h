@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "delta.h"
+#include "octopus.h"
+
+// \brief A history of States kept in a fixed-size ring buffer. Each State is stored as the XOR of it and the next one, run-length encoded by encode_delta, so only the bytes that changed between them take up space. The oldest States are dropped once the ring is full
+struct Rewind {
+    private: std::vector<uint8_t> ring;
+    // \brief Offset into this->ring the next record is written at
+    private: size_t head;
+    // \brief Offset into this->ring of the oldest record
+    private: size_t tail;
+    private: size_t used;
+    private: size_t records;
+
+    // \brief The State pushed last, which the newest record decodes against
+    private: State current;
+    private: bool has_current;
+    // \brief Holds a record while it is encoded or decoded, large enough for the worst case of a State that changed entirely
+    private: uint8_t scratch[max_delta_size(sizeof(State))];
+
+    // \brief Allocates a ring of the provided size in bytes. Nothing is allocated afterwards
+    public: Rewind(const size_t);
+
+    // \brief Records the provided State as the newest one
+    public: void push(const State&);
+    // \brief Steps one State back, writing the one pushed before the newest into the provided State and dropping the newest. Returns false if there is none
+    public: bool pop(State&);
+    // \brief Returns how many times this->pop can step back
+    public: size_t depth() const;
+    // \brief Drops the whole history
+    public: void clear();
+
+    // \brief Drops the oldest record
+    private: void drop_oldest();
+    // \brief Copies bytes into this->ring at the provided offset, wrapping around its end
+    private: void write(const size_t, const void*, const size_t);
+    // \brief Copies bytes out of this->ring at the provided offset, wrapping around its end
+    private: void read(const size_t, void*, const size_t) const;
+};
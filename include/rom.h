@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+// \brief The bytes of a ROM file, mapped into memory where the host supports it and read otherwise. "-" reads the ROM from stdin. The bytes stay valid until it is destroyed
+struct RomImage {
+    private: const uint8_t* data;
+    private: size_t size;
+    private: bool mapped;
+    // \brief Holds the bytes when they could not be mapped
+    private: std::vector<uint8_t> buffer;
+
+    public: RomImage(const std::string);
+    public: ~RomImage();
+    public: RomImage(const RomImage&) = delete;
+    public: RomImage& operator=(const RomImage&) = delete;
+
+    public: std::span<const uint8_t> bytes() const;
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+#include "jit.h"
+#include "octopus.h"
+#include "sync.h"
+
+// \brief Runs the provided amount of frames of the provided amount of instruction cycles past the present one, through the JIT if one is provided, and hands the framebuffer they leave to the renderer through the provided buffer, always marked dirty, as the renderer skips clean ones. Then rolls back to the present, kept in the provided State. The look-ahead runs with the keys held now, which is what makes a ROM react to them early. Predicted is whether the frame handed over last was drawn ahead, which then must be replaced even if nothing was drawn since. Returns the same for the frame handed over now
+bool run_ahead(CPU&, JIT*, const uint32_t, const uint32_t, State&, TripleBuffer<Framebuffer>&, const bool);
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <string>
+
+#include "octopus.h"
+
+// \brief Writes the provided state to file_path: a small versioned header followed by the State as raw bytes. The files are only portable between builds with the same State layout and endianness
+void write_state(const std::string, const State&);
+// \brief Reads a state written by write_state from file_path into the provided State, throwing if the file is not a valid save state of this version
+void read_state(const std::string, State&);
+// \brief Returns whether the provided sizeof(State) bytes hold a state the CPU can run from: sp within the stack and every bool 0 or 1. Restoring anything else, such as a corrupt or foreign file, would be undefined behavior
+bool is_valid_state(const uint8_t*);
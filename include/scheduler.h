@@ -0,0 +1,30 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// \brief Paces emulation in fixed 60 Hz frames. Each frame runs a batch of instruction cycles and one timer tick
+struct Scheduler {
+    public: static constexpr uint32_t FRAME_RATE = 60;
+
+    private: using Clock = std::chrono::steady_clock;
+
+    private: Clock::time_point start;
+    // \brief Frames handed out by this->frames_due since this->start
+    private: uint64_t frames;
+    private: bool throttled;
+
+    // \brief Amount of instruction cycles each frame runs
+    public: uint32_t instructions_per_frame;
+
+    // \brief Starts counting frames from now. An unthrottled scheduler runs frames back to back
+    public: Scheduler(const uint32_t, const bool);
+    // \brief Returns how many frames must run to catch up with the wall clock, and counts them as run. Always 1 when unthrottled
+    public: uint64_t frames_due();
+    // \brief Sleeps until the next frame is due. Returns immediately when unthrottled
+    public: void wait();
+    // \brief Counts frames from now again, so time spent away from the emulation, e.g. blocked on input, is not caught up on
+    public: void restart();
+    // \brief Returns the wall-clock time the provided frame is due at, counted from this->start
+    private: Clock::time_point deadline(const uint64_t) const;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// \brief Appends the provided amount of low bytes of the provided value to bytes, least significant first
+void put_fixed(std::string&, uint64_t, const size_t);
+// \brief Appends the provided value to bytes as a LEB128 varint, 7 bits per byte with the high bit set on all but the last, so small values take a single byte
+void put_varint(std::string&, uint64_t);
+
+// \brief Reads the fields put_fixed and put_varint write out of a file's bytes, throwing "truncated NAME" if they run out or "malformed NAME" for a varint past 64 bits, NAME being what the file is
+struct ByteReader {
+    public: const std::string& bytes;
+    public: size_t offset;
+    public: const char* name;
+
+    // \brief Reads a value of the provided amount of bytes, least significant first
+    public: uint64_t fixed(const size_t);
+    public: uint64_t varint();
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// Keeps the producer's and the consumer's indices on separate cache lines
+#define CACHE_LINE 64
+
+// \brief Hands the latest value from one producer thread to one consumer thread without locks. Neither side ever waits for the other: each owns a slot of its own, and they trade it for the shared middle one
+template<typename T>
+struct TripleBuffer {
+    private: static constexpr uint8_t INDEX = 0b011;
+    // \brief Set in this->middle while it holds a value the consumer did not take yet
+    private: static constexpr uint8_t FRESH = 0b100;
+
+    private: T slots[3];
+    // \brief The slot only the producer touches
+    private: uint8_t back = 0;
+    private: alignas(CACHE_LINE) std::atomic<uint8_t> middle = 1;
+    // \brief The slot only the consumer touches
+    private: alignas(CACHE_LINE) uint8_t front = 2;
+
+    // \brief Publishes a copy of the provided value. Called by the producer only
+    public: void write(const T& value) {
+        this->slots[this->back] = value;
+        this->back = this->middle.exchange(this->back | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    // \brief Returns the latest published value if it was not read yet, or nullptr otherwise. It stays valid and owned by the consumer until the next call. Called by the consumer only
+    public: T* read() {
+        if(!(this->middle.load(std::memory_order_relaxed) & FRESH)) return nullptr;
+        this->front = this->middle.exchange(this->front, std::memory_order_acq_rel) & INDEX;
+        return &this->slots[this->front];
+    }
+};
+
+// \brief A bounded queue between one producer thread and one consumer thread, without locks. Capacity must be a power of two
+template<typename T, size_t CAPACITY>
+struct SpscQueue {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0);
+
+    private: T items[CAPACITY];
+    // \brief Amount of items ever popped, written by the consumer only
+    private: alignas(CACHE_LINE) std::atomic<uint32_t> head = 0;
+    // \brief Amount of items ever pushed, written by the producer only
+    private: alignas(CACHE_LINE) std::atomic<uint32_t> tail = 0;
+
+    // \brief Appends the provided item. Returns false, dropping it, if the queue is full. Called by the producer only
+    public: bool push(const T& item) {
+        const auto tail = this->tail.load(std::memory_order_relaxed);
+        if(tail - this->head.load(std::memory_order_acquire) == CAPACITY) return false;
+
+        this->items[tail % CAPACITY] = item;
+        this->tail.store(tail + 1, std::memory_order_release);
+        this->tail.notify_one();
+        return true;
+    }
+
+    // \brief Appends as many of the provided items as fit, in order, returning how many. Called by the producer only
+    public: size_t push(const std::span<const T> values) {
+        const auto tail = this->tail.load(std::memory_order_relaxed);
+        const auto count = std::min<size_t>(values.size(), CAPACITY - (tail - this->head.load(std::memory_order_acquire)));
+
+        for(size_t index = 0; index < count; index++) this->items[(tail + index) % CAPACITY] = values[index];
+        this->tail.store(tail + count, std::memory_order_release);
+        this->tail.notify_one();
+        return count;
+    }
+
+    // \brief Appends every one of the provided items in order, or none if they do not all fit, returning whether they did. Called by the producer only
+    public: bool push_all(const std::span<const T> values) {
+        const auto tail = this->tail.load(std::memory_order_relaxed);
+        if(CAPACITY - (tail - this->head.load(std::memory_order_acquire)) < values.size()) return false;
+
+        for(size_t index = 0; index < values.size(); index++) this->items[(tail + index) % CAPACITY] = values[index];
+        this->tail.store(tail + values.size(), std::memory_order_release);
+        this->tail.notify_one();
+        return true;
+    }
+
+    // \brief Takes the oldest item into the provided one. Returns false if the queue is empty. Called by the consumer only
+    public: bool pop(T& item) {
+        const auto head = this->head.load(std::memory_order_relaxed);
+        if(head == this->tail.load(std::memory_order_acquire)) return false;
+
+        item = this->items[head % CAPACITY];
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // \brief Takes as many of the oldest items as the provided span holds, or every item if there are fewer, returning how many. Called by the consumer only
+    public: size_t pop(const std::span<T> values) {
+        const auto head = this->head.load(std::memory_order_relaxed);
+        const auto count = std::min<size_t>(values.size(), this->tail.load(std::memory_order_acquire) - head);
+
+        for(size_t index = 0; index < count; index++) values[index] = this->items[(head + index) % CAPACITY];
+        this->head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // \brief Drops the oldest items until at most the provided amount are left. Called by the consumer only
+    public: void trim(const size_t count) {
+        const auto head = this->head.load(std::memory_order_relaxed);
+        const size_t size = this->tail.load(std::memory_order_acquire) - head;
+        if(size > count) this->head.store(head + (size - count), std::memory_order_release);
+    }
+
+    // \brief Sleeps until the queue holds an item. Called by the consumer only
+    public: void wait() const {
+        this->tail.wait(this->head.load(std::memory_order_relaxed), std::memory_order_acquire);
+    }
+};
+
+#undef CACHE_LINE
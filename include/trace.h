@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "octopus.h"
+
+// \brief One executed instruction and the registers it may have changed, as they were right after it
+struct TraceRecord {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t i;
+    uint8_t vx;
+    uint8_t vf;
+};
+
+// \brief Execution-loop policy for CPU::run that keeps the last executed instructions in a fixed-size ring, overwriting the oldest ones. Tracing can be paused and resumed at any time through this->enabled
+struct Tracer {
+    public: bool enabled = true;
+
+    private: std::vector<TraceRecord> ring;
+    // \brief Index into this->ring the next record is written at
+    private: size_t next = 0;
+    // \brief Records written since the start, including the overwritten ones
+    private: uint64_t written = 0;
+    // \brief The record of the instruction being executed, completed once it has retired
+    private: TraceRecord pending;
+
+    // \brief Allocates a ring for the provided amount of records. Nothing is allocated afterwards
+    public: Tracer(const size_t);
+
+    // \brief Starts a record for the instruction at the provided state's program counter. Called before executing it
+    public: void instruction(const State& state, const Instruction&) {
+        if(!this->enabled) return;
+        this->pending.pc = state.pc;
+        this->pending.opcode = (state.ram[state.pc % sizeof state.ram] << 8) | state.ram[(state.pc + 1) % sizeof state.ram];
+    }
+
+    // \brief Completes the record started by this->instruction with the registers after executing it
+    public: void retired(const State& state, const Instruction& instruction) {
+        if(!this->enabled) return;
+        this->pending.i = state.i;
+        this->pending.vx = state.v[instruction.x];
+        this->pending.vf = state.v[0xf];
+
+        this->ring[this->next] = this->pending;
+        if(++this->next == this->ring.size()) this->next = 0;
+        this->written++;
+    }
+
+    // \brief Writes the records in the ring to file_path, oldest first: a small header followed by each record in little-endian
+    public: void write(const std::string) const;
+};
+
+// \brief Reads the records written by Tracer::write from file_path, oldest first. Returns how many instructions were traced in total, including the ones overwritten before the dump
+uint64_t read_trace(const std::string, std::vector<TraceRecord>&);
@@ -0,0 +1,33 @@
+#include <algorithm>
+
+#include "audio.h"
+
+// How often SFML checks whether a chunk was played, well under the time the chunks it queued last, so they never all run out before it refills one
+#define PROCESSING_INTERVAL sf::milliseconds(1)
+
+Audio::Audio() {
+    this->initialize(1, Buzzer::SAMPLE_RATE);
+    this->setProcessingInterval(PROCESSING_INTERVAL);
+}
+
+Audio::~Audio() {
+    this->stop();
+}
+
+void Audio::push_frame(const CPU& processor) {
+    this->buzzer.push_frame(processor);
+}
+
+bool Audio::onGetData(sf::SoundStream::Chunk& data) {
+    const auto count = this->buzzer.pop(std::span<int16_t>(this->chunk), MAX_BUFFERED);
+    std::fill(std::begin(this->chunk) + count, std::end(this->chunk), 0);
+
+    data.samples = this->chunk;
+    data.sampleCount = CHUNK_SIZE;
+    // Never ends the stream, which SFML would not restart on its own
+    return true;
+}
+
+void Audio::onSeek(sf::Time) {}
+
+#undef PROCESSING_INTERVAL
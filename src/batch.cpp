@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <deque>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include "batch.h"
+#include "jit.h"
+#include "octopus.h"
+
+// \brief The jobs queued on one worker. Its owner pops from the back, thieves take from the front
+struct WorkQueue {
+    public: std::mutex lock;
+    public: std::deque<size_t> jobs;
+
+    public: bool pop(size_t& job) {
+        std::lock_guard guard(this->lock);
+        if(this->jobs.empty()) return false;
+        job = this->jobs.back();
+        this->jobs.pop_back();
+        return true;
+    }
+
+    public: bool steal(size_t& job) {
+        std::lock_guard guard(this->lock);
+        if(this->jobs.empty()) return false;
+        job = this->jobs.front();
+        this->jobs.pop_front();
+        return true;
+    }
+};
+
+JobResult run_job(const Job&, const BatchOptions&);
+
+std::vector<Job> read_jobs(const std::string file_path, const uint64_t seed) {
+    std::ifstream file(file_path);
+    if(!file.is_open()) {
+        throw std::runtime_error(std::format("could not open jobs file: {}\n", file_path));
+    }
+
+    std::vector<Job> jobs;
+    std::string line;
+    for(size_t number = 1; std::getline(file, line); number++) {
+        if(line.empty() || line.starts_with('#')) continue;
+
+        std::istringstream fields(line);
+        Job job;
+        if(!(fields >> job.rom_path >> job.cycles)) {
+            throw std::runtime_error(std::format("{}:{}: expected a rom path and a cycle count\n", file_path, number));
+        }
+        if(!(fields >> job.seed)) job.seed = seed;
+        jobs.push_back(job);
+    }
+
+    return jobs;
+}
+
+std::vector<JobResult> run_batch(const std::vector<Job>& jobs, const BatchOptions& options) {
+    std::vector<JobResult> results(jobs.size());
+    const auto threads = std::max<size_t>(1, std::min(options.threads, jobs.size()));
+
+    // Dealt round-robin up front. Nothing is queued afterwards, so a worker is done once every queue is empty
+    std::vector<WorkQueue> queues(threads);
+    for(size_t job = 0; job < jobs.size(); job++) queues[job % threads].jobs.push_back(job);
+
+    const auto work = [&](const size_t self) {
+        size_t job;
+        while(true) {
+            auto found = queues[self].pop(job);
+            for(size_t offset = 1; !found && offset < threads; offset++) {
+                found = queues[(self + offset) % threads].steal(job);
+            }
+            if(!found) return;
+
+            results[job] = run_job(jobs[job], options);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for(size_t self = 1; self < threads; self++) workers.emplace_back(work, self);
+    work(0);
+    for(auto& worker : workers) worker.join();
+
+    return results;
+}
+
+JobResult run_job(const Job& job, const BatchOptions& options) {
+    JobResult result{0, 0, ""};
+
+    CPU processor;
+    std::unique_ptr<JIT> recompiler;
+
+    try {
+        processor.init(job.seed);
+        processor.set_profile(options.profile);
+        processor.dump_into_memory(job.rom_path);
+        if(options.jit) recompiler = std::make_unique<JIT>(processor);
+
+        const uint64_t frame = options.instructions_per_frame;
+        while(result.cycles < job.cycles) {
+            const auto cycles = std::min(frame, job.cycles - result.cycles);
+            const auto status = (recompiler != nullptr) ? recompiler->run(cycles) : processor.run(cycles);
+            result.cycles += status.cycles;
+            if(status.fault != Fault::NONE) {
+                result.fault = std::format("{} at {:03x} ({:04x})", describe(status.fault), status.pc, status.opcode);
+                break;
+            }
+            processor.tick();
+        }
+    } catch(const std::exception& error) {
+        result.fault = error.what();
+        while(!result.fault.empty() && result.fault.back() == '\n') result.fault.pop_back();
+    }
+
+    result.framebuffer_hash = processor.get_framebuffer().hash();
+    return result;
+}
@@ -0,0 +1,38 @@
+#include <algorithm>
+#include <cmath>
+
+#include "buzzer.h"
+
+// Pattern samples per second at pitch 64, XO-CHIP's default
+#define BASE_RATE 4000.0
+#define PATTERN_BITS 128
+#define AMPLITUDE 6000
+
+Buzzer::Buzzer() : phase(0) {}
+
+void Buzzer::push_frame(const CPU& processor) {
+    if(processor.get_sound_timer() == 0) {
+        // Restarts the pattern the next time the buzzer plays, instead of resuming it mid-way
+        this->phase = 0;
+        std::fill(std::begin(this->frame), std::end(this->frame), 0);
+    } else {
+        const auto pattern = processor.get_pattern();
+        const auto step = BASE_RATE * std::exp2((processor.get_pitch() - 64) / 48.0) / SAMPLE_RATE;
+        for(auto& sample : this->frame) {
+            const auto bit = static_cast<size_t>(this->phase);
+            sample = ((pattern[bit / 8] >> (7 - bit % 8)) & 0x01) ? AMPLITUDE : -AMPLITUDE;
+            this->phase = std::fmod(this->phase + step, PATTERN_BITS);
+        }
+    }
+
+    this->samples.push(std::span<const int16_t>(this->frame));
+}
+
+size_t Buzzer::pop(const std::span<int16_t> destination, const size_t buffered) {
+    this->samples.trim(buffered);
+    return this->samples.pop(destination);
+}
+
+#undef BASE_RATE
+#undef PATTERN_BITS
+#undef AMPLITUDE
@@ -0,0 +1,197 @@
+#include <format>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TCP_HOST
+#include <netdb.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "capture.h"
+#include "serial.h"
+
+#define MAGIC "OCTV"
+#define VERSION 1
+#define TCP_PREFIX "tcp://"
+// A frame delta and a record length as varints, plus the resolution
+#define MAX_RECORD_HEADER (2 * 10 + 1)
+// Bytes the sender takes off the queue at a time
+#define SEND_CHUNK 4096
+// A viewer that takes nothing for this long is taken as gone, so stopping never waits on it
+#define SEND_TIMEOUT_SECONDS 1
+
+static int connect_to(const std::string address) {
+#ifdef TCP_HOST
+    const auto separator = address.rfind(':');
+    if(separator == std::string::npos) throw std::runtime_error(std::format("capture address has no port: {}\n", address));
+    const auto host = address.substr(0, separator);
+    const auto port = address.substr(separator + 1);
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    if(getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0) throw std::runtime_error(std::format("could not resolve capture address: {}\n", address));
+
+    int connection = -1;
+    for(auto* result = results; result != nullptr && connection < 0; result = result->ai_next) {
+        connection = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+        if(connection >= 0 && connect(connection, result->ai_addr, result->ai_addrlen) != 0) {
+            close(connection);
+            connection = -1;
+        }
+    }
+    freeaddrinfo(results);
+
+    if(connection < 0) throw std::runtime_error(std::format("could not connect to capture viewer: {}\n", address));
+    const timeval timeout{SEND_TIMEOUT_SECONDS, 0};
+    setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+    return connection;
+#else
+    throw std::runtime_error(std::format("tcp capture is not supported on this host: {}\n", address));
+#endif
+}
+
+Capture::Capture(const std::string destination) : connection(-1), pushed(0), stopping(false), previous{}, hires(false), frame(0), image{} {
+    if(destination.starts_with(TCP_PREFIX)) {
+        this->connection = connect_to(destination.substr(std::string(TCP_PREFIX).size()));
+    } else {
+        this->file.open(destination, std::ios::binary);
+        if(!this->file.is_open()) throw std::runtime_error(std::format("could not open capture: {}\n", destination));
+    }
+
+    // Reserved once, so pushing a frame never allocates
+    this->record.reserve(MAX_RECORD_HEADER + max_delta_size(this->image.size()));
+    this->record = MAGIC;
+    put_fixed(this->record, VERSION, sizeof(uint32_t));
+    this->send(reinterpret_cast<const uint8_t*>(this->record.data()), this->record.size());
+    if(this->connection >= 0) this->sender = std::thread(&Capture::stream, this);
+}
+
+Capture::~Capture() {
+    if(this->sender.joinable()) {
+        this->stopping.store(true, std::memory_order_release);
+        this->pushed.fetch_add(1, std::memory_order_release);
+        this->pushed.notify_one();
+        this->sender.join();
+    }
+#ifdef TCP_HOST
+    if(this->connection >= 0) close(this->connection);
+#endif
+}
+
+void Capture::push(const Framebuffer& framebuffer, const uint64_t frame) {
+    if(!framebuffer.is_dirty()) return;
+
+    // Low resolution leaves the rest of the image off, whatever high resolution left in it
+    if(!framebuffer.is_hires()) this->image.fill(0);
+    const uint8_t words = framebuffer.get_width() / 64;
+    constexpr auto bytes_per_row = Framebuffer::WIDTH / 8;
+    for(uint8_t y = 0; y < framebuffer.get_height(); y++) {
+        auto* row = &this->image[y * bytes_per_row];
+        for(uint8_t word = 0; word < words; word++) {
+            const auto pixels = framebuffer.get_word(word, y);
+            for(int8_t shift = 56; shift >= 0; shift -= 8) *row++ = static_cast<uint8_t>(pixels >> shift);
+        }
+    }
+    // DRW redrawing the same pixels, e.g. erasing and drawing a sprite back in one frame, sends nothing
+    if(framebuffer.is_hires() == this->hires && this->image == this->previous) return;
+
+    this->record.clear();
+    put_varint(this->record, frame - this->frame);
+    this->record.push_back(framebuffer.is_hires());
+    uint8_t delta[max_delta_size(sizeof this->image)];
+    const auto length = encode_delta(this->previous.data(), this->image.data(), this->image.size(), delta);
+    put_varint(this->record, length);
+    this->record.append(reinterpret_cast<const char*>(delta), length);
+    // Dropped whole if the viewer fell behind. The next record is then taken against the last frame it was sent, so it still decodes
+    if(!this->send(reinterpret_cast<const uint8_t*>(this->record.data()), this->record.size())) return;
+
+    this->previous = this->image;
+    this->hires = framebuffer.is_hires();
+    this->frame = frame;
+}
+
+bool Capture::send(const uint8_t* bytes, const size_t size) {
+    if(this->file.is_open()) {
+        this->file.write(reinterpret_cast<const char*>(bytes), size);
+        return true;
+    }
+
+    if(!this->outgoing.push_all(std::span<const uint8_t>(bytes, size))) return false;
+    this->pushed.fetch_add(1, std::memory_order_release);
+    this->pushed.notify_one();
+    return true;
+}
+
+void Capture::stream() {
+    uint8_t chunk[SEND_CHUNK];
+    auto seen = this->pushed.load(std::memory_order_acquire);
+    while(true) {
+        // Read before draining, so everything queued before stopping is drained too, unless the viewer went away
+        const auto stop = this->stopping.load(std::memory_order_acquire);
+        for(size_t count; (count = this->outgoing.pop(std::span<uint8_t>(chunk))) > 0;) {
+#ifdef TCP_HOST
+            for(size_t sent = 0; this->connection >= 0 && sent < count;) {
+                // Without MSG_NOSIGNAL a viewer that went away would kill the process with SIGPIPE
+                const auto written = ::send(this->connection, chunk + sent, count - sent, MSG_NOSIGNAL);
+                if(written <= 0) {
+                    close(this->connection);
+                    this->connection = -1;
+                    break;
+                }
+                sent += written;
+            }
+#endif
+        }
+        if(stop) break;
+
+        this->pushed.wait(seen, std::memory_order_acquire);
+        seen = this->pushed.load(std::memory_order_acquire);
+    }
+}
+
+std::vector<CapturedFrame> read_capture(const std::string file_path) {
+    std::ifstream file(file_path, std::ios::binary);
+    if(!file.is_open()) {
+        throw std::runtime_error(std::format("could not open capture: {}\n", file_path));
+    }
+
+    const std::string bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if(!bytes.starts_with(MAGIC)) {
+        throw std::runtime_error(std::format("not a capture: {}\n", file_path));
+    }
+
+    ByteReader reader{bytes, sizeof MAGIC - 1, "capture"};
+    const auto version = reader.fixed(sizeof(uint32_t));
+    if(version != VERSION) {
+        throw std::runtime_error(std::format("capture version not supported: {}\n", version));
+    }
+
+    std::vector<CapturedFrame> frames;
+    CapturedFrame current{0, false, {}};
+    while(reader.offset < bytes.size()) {
+        current.frame += reader.varint();
+        current.hires = (reader.fixed(1) != 0);
+        const auto length = reader.varint();
+        if(bytes.size() - reader.offset < length) throw std::runtime_error("truncated capture\n");
+
+        const auto delta = reinterpret_cast<const uint8_t*>(bytes.data() + reader.offset);
+        if(!decode_delta(delta, length, current.image.data(), current.image.size())) throw std::runtime_error("malformed capture\n");
+        reader.offset += length;
+        frames.push_back(current);
+    }
+
+    return frames;
+}
+
+#undef TCP_HOST
+#undef MAGIC
+#undef VERSION
+#undef TCP_PREFIX
+#undef MAX_RECORD_HEADER
+#undef SEND_CHUNK
+#undef SEND_TIMEOUT_SECONDS
@@ -0,0 +1,67 @@
+#include <cstring>
+
+#include "delta.h"
+
+// Unchanged bytes shorter than this are kept inside the changed run around them, as splitting it would cost more than the bytes themselves
+#define MIN_UNCHANGED_RUN 4
+#define RUN_SIZE (2 * sizeof(uint16_t))
+
+static void put_length(uint8_t* output, const size_t length) {
+    output[0] = static_cast<uint8_t>(length);
+    output[1] = static_cast<uint8_t>(length >> 8);
+}
+
+static size_t get_length(const uint8_t* input) {
+    return input[0] | (input[1] << 8);
+}
+
+size_t encode_delta(const uint8_t* older, const uint8_t* newer, const size_t size, uint8_t* output) {
+    size_t length = 0;
+    size_t position = 0;
+
+    while(position < size) {
+        const auto unchanged_start = position;
+        // Compares a word at a time first, as most of the bytes usually did not change
+        for(uint64_t a, b; position + sizeof a <= size; position += sizeof a) {
+            std::memcpy(&a, older + position, sizeof a);
+            std::memcpy(&b, newer + position, sizeof b);
+            if(a != b) break;
+        }
+        while(position < size && older[position] == newer[position]) position++;
+
+        const auto changed_start = position;
+        size_t unchanged = 0;
+        while(position < size && unchanged < MIN_UNCHANGED_RUN) {
+            unchanged = (older[position] == newer[position]) ? unchanged + 1 : 0;
+            position++;
+        }
+        if(unchanged == MIN_UNCHANGED_RUN) position -= MIN_UNCHANGED_RUN;
+
+        put_length(output + length, changed_start - unchanged_start);
+        put_length(output + length + sizeof(uint16_t), position - changed_start);
+        length += RUN_SIZE;
+        for(size_t index = changed_start; index < position; index++) output[length++] = older[index] ^ newer[index];
+    }
+
+    return length;
+}
+
+bool decode_delta(const uint8_t* delta, const size_t length, uint8_t* target, const size_t size) {
+    size_t offset = 0;
+    size_t position = 0;
+
+    while(offset < length) {
+        if(length - offset < RUN_SIZE) return false;
+        const auto unchanged = get_length(delta + offset);
+        const auto changed = get_length(delta + offset + sizeof(uint16_t));
+        offset += RUN_SIZE;
+        if(size - position < unchanged + changed || length - offset < changed) return false;
+
+        position += unchanged;
+        for(size_t index = 0; index < changed; index++) target[position++] ^= delta[offset++];
+    }
+    return true;
+}
+
+#undef MIN_UNCHANGED_RUN
+#undef RUN_SIZE
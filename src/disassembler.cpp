@@ -0,0 +1,56 @@
+#include <format>
+
+#include "disassembler.h"
+#include "octopus.h"
+
+std::string disassemble(const uint16_t opcode) {
+    const auto instruction = CPU::decode(opcode);
+    const auto x = instruction.x;
+    const auto y = instruction.y;
+
+    switch(instruction.operation) {
+        case Operation::SYS: return std::format("SYS {:03x}", instruction.nnn);
+        case Operation::CLS: return "CLS";
+        case Operation::RET: return "RET";
+        case Operation::SCD: return std::format("SCD {:x}", instruction.n);
+        case Operation::SCR: return "SCR";
+        case Operation::SCL: return "SCL";
+        case Operation::LOW: return "LOW";
+        case Operation::HIGH: return "HIGH";
+        case Operation::JP: return std::format("JP {:03x}", instruction.nnn);
+        case Operation::CALL: return std::format("CALL {:03x}", instruction.nnn);
+        case Operation::SE_BYTE: return std::format("SE V{:x}, {:02x}", x, instruction.nn);
+        case Operation::SNE_BYTE: return std::format("SNE V{:x}, {:02x}", x, instruction.nn);
+        case Operation::SE_REGISTER: return std::format("SE V{:x}, V{:x}", x, y);
+        case Operation::LD_BYTE: return std::format("LD V{:x}, {:02x}", x, instruction.nn);
+        case Operation::ADD_BYTE: return std::format("ADD V{:x}, {:02x}", x, instruction.nn);
+        case Operation::LD_REGISTER: return std::format("LD V{:x}, V{:x}", x, y);
+        case Operation::OR: return std::format("OR V{:x}, V{:x}", x, y);
+        case Operation::AND: return std::format("AND V{:x}, V{:x}", x, y);
+        case Operation::XOR: return std::format("XOR V{:x}, V{:x}", x, y);
+        case Operation::ADD_REGISTER: return std::format("ADD V{:x}, V{:x}", x, y);
+        case Operation::SUB: return std::format("SUB V{:x}, V{:x}", x, y);
+        case Operation::SHR: return std::format("SHR V{:x}", x);
+        case Operation::SUBN: return std::format("SUBN V{:x}, V{:x}", x, y);
+        case Operation::SHL: return std::format("SHL V{:x}", x);
+        case Operation::SNE_REGISTER: return std::format("SNE V{:x}, V{:x}", x, y);
+        case Operation::LD_I: return std::format("LD I, {:03x}", instruction.nnn);
+        case Operation::JP_V0: return std::format("JP V0, {:03x}", instruction.nnn);
+        case Operation::RND: return std::format("RND V{:x}, {:02x}", x, instruction.nn);
+        case Operation::DRW: return std::format("DRW V{:x}, V{:x}, {:x}", x, y, instruction.n);
+        case Operation::SKP: return std::format("SKP V{:x}", x);
+        case Operation::SKNP: return std::format("SKNP V{:x}", x);
+        case Operation::LD_VX_DT: return std::format("LD V{:x}, DT", x);
+        case Operation::LD_VX_K: return std::format("LD V{:x}, K", x);
+        case Operation::LD_DT_VX: return std::format("LD DT, V{:x}", x);
+        case Operation::LD_ST_VX: return std::format("LD ST, V{:x}", x);
+        case Operation::ADD_I: return std::format("ADD I, V{:x}", x);
+        case Operation::LD_F: return std::format("LD F, V{:x}", x);
+        case Operation::LD_B: return std::format("LD B, V{:x}", x);
+        case Operation::LD_MEMORY_VX: return std::format("LD [I], V{:x}", x);
+        case Operation::LD_VX_MEMORY: return std::format("LD V{:x}, [I]", x);
+        case Operation::LD_AUDIO: return "LD AUDIO, [I]";
+        case Operation::LD_PITCH: return std::format("LD PITCH, V{:x}", x);
+        default: return std::format("DW {:04x}", opcode);
+    }
+}
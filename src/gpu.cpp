@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+#include "gpu.h"
+
+// Window pixels per high resolution pixel when it opens, low resolution ones being twice as large
+#define SCALE_FACTOR 5
+// Fraction of its previous color a pixel keeps per frame once turned off, with phosphors
+#define PERSISTENCE 0.6f
+// Frames a pixel turned off takes to fade out, the last of which drops what rounding would leave lit
+#define FADE_FRAMES 8
+
+#define ON_COLOR sf::Color(30, 144, 255)
+#define OFF_COLOR sf::Color::Black
+
+// Runs over the high resolution screen, finding the bit of each pixel in the texel holding its 32 pixels. GLSL 1.10 has no integer operations, so bits are extracted with floats, which are exact for values this small
+static const char* const EXPAND_SHADER = R"(
+uniform sampler2D bits;
+uniform sampler2D previous;
+uniform vec2 resolution;
+uniform vec2 target;
+uniform float persistence;
+uniform vec4 on_color;
+uniform vec4 off_color;
+
+void main() {
+    vec2 pixel = floor(gl_TexCoord[0].xy * resolution);
+    vec4 texel = texture2D(bits, vec2((floor(pixel.x / 32.0) + 0.5) / 4.0, (pixel.y + 0.5) / 64.0));
+    float channel = mod(floor(pixel.x / 8.0), 4.0);
+    float byte = floor(255.0 * (channel < 1.0 ? texel.r : channel < 2.0 ? texel.g : channel < 3.0 ? texel.b : texel.a) + 0.5);
+    float lit = mod(floor(byte / exp2(7.0 - mod(pixel.x, 8.0))), 2.0);
+    vec4 faded = mix(off_color, texture2D(previous, gl_FragCoord.xy / target), persistence);
+    gl_FragColor = (lit > 0.5) ? on_color : faded;
+}
+)";
+
+sf::RenderWindow& GPU::init(const bool phosphor) {
+    const auto width = Framebuffer::WIDTH;
+    const auto height = Framebuffer::HEIGHT;
+    this->active_screen.create(sf::VideoMode(width * SCALE_FACTOR, height * SCALE_FACTOR), "octopus", sf::Style::Default);
+
+    if(!sf::Shader::isAvailable() || !this->expand.loadFromMemory(EXPAND_SHADER, sf::Shader::Fragment)) {
+        throw std::runtime_error(std::format("could not compile the screen's shader\n"));
+    }
+    if(!this->bits.create(width / PIXELS_PER_TEXEL, height)) throw std::runtime_error(std::format("could not create the screen's textures\n"));
+    for(auto& screen : this->history) {
+        if(!screen.create(width, height)) throw std::runtime_error(std::format("could not create the screen's textures\n"));
+        screen.clear(OFF_COLOR);
+        screen.display();
+    }
+
+    this->drawable_bits.setTexture(this->bits);
+    this->drawable_bits.setScale(PIXELS_PER_TEXEL, 1);
+    this->expand.setUniform("bits", sf::Shader::CurrentTexture);
+    this->expand.setUniform("target", sf::Glsl::Vec2(width, height));
+    this->expand.setUniform("on_color", sf::Glsl::Vec4(ON_COLOR));
+    this->expand.setUniform("off_color", sf::Glsl::Vec4(OFF_COLOR));
+
+    this->current = 0;
+    this->resolution = {Framebuffer::LORES_WIDTH, Framebuffer::LORES_HEIGHT};
+    this->phosphor = phosphor;
+    this->fading = 0;
+    this->drawable_graphics.setTexture(this->history[this->current].getTexture());
+    this->resize(width * SCALE_FACTOR, height * SCALE_FACTOR);
+
+    return this->active_screen;
+}
+
+void GPU::draw(Framebuffer& framebuffer) {
+    if(!framebuffer.is_dirty()) return;
+
+    // 256 bytes in low resolution and 1 KB in high resolution, instead of a color per pixel
+    const uint8_t words = framebuffer.get_width() / 64;
+    const auto height = framebuffer.get_height();
+    auto* byte = this->packed.data();
+    for(uint8_t y = 0; y < height; y++) {
+        for(uint8_t word = 0; word < words; word++) {
+            const auto pixels = framebuffer.get_word(word, y);
+            for(int8_t shift = 56; shift >= 0; shift -= 8) *byte++ = static_cast<uint8_t>(pixels >> shift);
+        }
+    }
+    this->bits.update(this->packed.data(), words * 64 / PIXELS_PER_TEXEL, height, 0, 0);
+    this->resolution = {static_cast<float>(framebuffer.get_width()), static_cast<float>(height)};
+    framebuffer.set_clean();
+
+    this->fading = this->phosphor ? FADE_FRAMES : 0;
+    this->render(this->phosphor ? PERSISTENCE : 0.0f);
+    this->redraw();
+}
+
+bool GPU::fade() {
+    if(this->fading == 0) return false;
+
+    this->fading--;
+    this->render((this->fading > 0) ? PERSISTENCE : 0.0f);
+    this->redraw();
+    return true;
+}
+
+void GPU::resize(const uint32_t width, const uint32_t height) {
+    this->active_screen.setView(sf::View(sf::FloatRect(0, 0, width, height)));
+
+    const auto scale = std::min(static_cast<float>(width) / Framebuffer::WIDTH, static_cast<float>(height) / Framebuffer::HEIGHT);
+    this->drawable_graphics.setScale(scale, scale);
+    this->drawable_graphics.setPosition((width - Framebuffer::WIDTH * scale) / 2, (height - Framebuffer::HEIGHT * scale) / 2);
+    this->redraw();
+}
+
+void GPU::redraw() {
+    this->active_screen.clear(OFF_COLOR);
+    this->active_screen.draw(this->drawable_graphics);
+    this->active_screen.display();
+}
+
+void GPU::render(const float persistence) {
+    const auto next = 1 - this->current;
+    this->expand.setUniform("previous", this->history[this->current].getTexture());
+    this->expand.setUniform("resolution", sf::Glsl::Vec2(this->resolution));
+    this->expand.setUniform("persistence", persistence);
+
+    // Every pixel is written, so there is nothing to blend with
+    sf::RenderStates states(&this->expand);
+    states.blendMode = sf::BlendNone;
+    this->history[next].draw(this->drawable_bits, states);
+    this->history[next].display();
+
+    this->current = next;
+    this->drawable_graphics.setTexture(this->history[this->current].getTexture());
+}
+
+#undef SCALE_FACTOR
+#undef PERSISTENCE
+#undef FADE_FRAMES
+#undef ON_COLOR
+#undef OFF_COLOR
@@ -0,0 +1,56 @@
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "input.h"
+
+void InputQueue::push(const KeyEvent& event) {
+    this->events.push_back(event);
+}
+
+void InputQueue::apply(CPU& processor, const uint64_t frame) {
+    for(; this->next < this->events.size() && this->events[this->next].frame <= frame; this->next++) {
+        const auto& event = this->events[this->next];
+        processor.set_key(event.key, event.pressed);
+    }
+
+    // Keeps the capacity, so interactive play stops allocating once the queue has grown to a frame's worth of events
+    if(this->next == this->events.size()) {
+        this->events.clear();
+        this->next = 0;
+    }
+}
+
+bool InputQueue::empty() const {
+    return this->next == this->events.size();
+}
+
+void read_input(const std::string file_path, InputQueue& queue) {
+    std::ifstream file(file_path);
+    if(!file.is_open()) {
+        throw std::runtime_error(std::format("could not open input file: {}\n", file_path));
+    }
+
+    std::string line;
+    uint64_t last_frame = 0;
+    for(size_t number = 1; std::getline(file, line); number++) {
+        if(line.empty() || line.starts_with('#')) continue;
+
+        std::istringstream fields(line);
+        KeyEvent event;
+        uint32_t key;
+        std::string action;
+        if(!(fields >> event.frame >> std::hex >> key >> action) || key > 0xf || (action != "down" && action != "up")) {
+            throw std::runtime_error(std::format("{}:{}: expected a frame, a key from 0 to f and down or up\n", file_path, number));
+        }
+        if(event.frame < last_frame) {
+            throw std::runtime_error(std::format("{}:{}: events must be in frame order\n", file_path, number));
+        }
+
+        event.key = key;
+        event.pressed = (action == "down");
+        last_frame = event.frame;
+        queue.push(event);
+    }
+}
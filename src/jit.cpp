@@ -0,0 +1,370 @@
+#include <cstring>
+#include <initializer_list>
+
+#include "jit.h"
+
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_HOST
+#include <sys/mman.h>
+#endif
+
+#define CODE_SIZE (1 << 20)
+// Instructions and host bytes a single block may take at most
+#define BLOCK_INSTRUCTIONS 64
+#define BLOCK_BYTES 4096
+
+#define ADDRESS_MASK 0x0fff
+#define OPCODE_SPAN 2
+
+// Set in the value a block returns when the remaining budget was too small to run it
+#define BAIL 0x10000
+#define NOT_TRANSLATED -1
+#define INTERPRETED -2
+// Offset of the single ret every unlinked exit jumps to
+#define RETURN_STUB 0
+
+// A block is called as block(cpu.state.v, &cpu.state.i, &budget), with the arguments living in rdi, rsi and rdx for its whole
+// execution. It returns the program counter it exited at, which is also how chained blocks hand over to each other
+using Block = uint32_t (*)(uint8_t*, uint16_t*, uint64_t*);
+
+// \brief Appends x86-64 machine code to a buffer
+struct Assembler {
+    public: uint8_t* base;
+    public: size_t offset;
+
+    public: void emit(const std::initializer_list<uint8_t> bytes) {
+        for(const auto byte : bytes) this->base[this->offset++] = byte;
+    }
+
+    public: void emit32(const uint32_t value) {
+        std::memcpy(this->base + this->offset, &value, sizeof value);
+        this->offset += sizeof value;
+    }
+
+    public: void patch32(const size_t at, const uint32_t value) {
+        std::memcpy(this->base + at, &value, sizeof value);
+    }
+
+    // movzx eax, byte [rdi + index]
+    public: void load_eax(const uint8_t index) { this->emit({0x0f, 0xb6, 0x47, index}); }
+    // movzx ecx, byte [rdi + index]
+    public: void load_ecx(const uint8_t index) { this->emit({0x0f, 0xb6, 0x4f, index}); }
+    // mov byte [rdi + index], al
+    public: void store_al(const uint8_t index) { this->emit({0x88, 0x47, index}); }
+    // mov byte [rdi + 0xf], r8b
+    public: void store_flag() { this->emit({0x44, 0x88, 0x47, 0x0f}); }
+};
+
+JIT::JIT(CPU& processor) : cpu(processor), code(nullptr), code_used(0) {
+#ifdef JIT_HOST
+    void* memory = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory != MAP_FAILED) this->code = static_cast<uint8_t*>(memory);
+#endif
+    this->flush();
+}
+
+JIT::~JIT() {
+#ifdef JIT_HOST
+    if(this->code != nullptr) munmap(this->code, CODE_SIZE);
+#endif
+}
+
+bool JIT::supported() {
+#ifdef JIT_HOST
+    return true;
+#else
+    return false;
+#endif
+}
+
+void JIT::flush() {
+    for(auto& block : this->blocks) block = NOT_TRANSLATED;
+    std::memset(this->covered, 0, sizeof this->covered);
+    this->exits.clear();
+
+    if(this->code == nullptr) return;
+    this->protect(true);
+    this->code[RETURN_STUB] = 0xc3; // ret
+    this->code_used = RETURN_STUB + 1;
+    this->protect(false);
+}
+
+void JIT::restore(const State& state) {
+    // Going back a few frames rarely changes code, so the blocks usually survive
+    for(size_t address = 0; address < sizeof this->covered; address++) {
+        if(!this->covered[address] || this->cpu.state.ram[address] == state.ram[address]) continue;
+        this->flush();
+        break;
+    }
+    this->cpu.restore(state);
+}
+
+void JIT::protect(const bool writable) {
+#ifdef JIT_HOST
+    mprotect(this->code, CODE_SIZE, writable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC));
+#else
+    (void) writable;
+#endif
+}
+
+void JIT::interpret() {
+    // FX33 and FX55 are the only instructions that store into ram, where I points before they run
+    const auto instruction = CPU::decode(this->cpu.fetch_opcode());
+    const size_t address = this->cpu.state.i;
+    size_t length = 0;
+    if(instruction.operation == Operation::LD_B) length = 3;
+    if(instruction.operation == Operation::LD_MEMORY_VX) length = instruction.x + 1;
+
+    this->cpu.cycle();
+
+    for(size_t index = address; index < address + length && index < sizeof this->covered; index++) {
+        if(!this->covered[index]) continue;
+        this->flush();
+        break;
+    }
+}
+
+int32_t JIT::translate(const uint16_t start) {
+    if(this->code_used + BLOCK_BYTES > CODE_SIZE) this->flush();
+
+    this->protect(true);
+    Assembler assembler{this->code, this->code_used};
+
+    // Runs the block only if the budget covers all of its instructions, otherwise returns to the dispatcher
+    assembler.emit({0x48, 0x81, 0x3a}); // cmp qword [rdx], count
+    const auto count_check = assembler.offset;
+    assembler.emit32(0);
+    assembler.emit({0x73, 0x06}); // jae body
+    assembler.emit({0xb8}); // mov eax, BAIL | start
+    assembler.emit32(BAIL | start);
+    assembler.emit({0xc3}); // ret
+    assembler.emit({0x48, 0x81, 0x2a}); // sub qword [rdx], count
+    const auto count_subtract = assembler.offset;
+    assembler.emit32(0);
+
+    const auto exit_to = [&](const uint16_t target) {
+        assembler.emit({0xb8}); // mov eax, target
+        assembler.emit32(target);
+        assembler.emit({0xe9}); // jmp rel32
+        const auto offset = static_cast<uint32_t>(assembler.offset);
+        assembler.emit32(0);
+
+        const auto linked = (target <= ADDRESS_MASK) && (this->blocks[target] >= 0);
+        const auto destination = linked ? this->blocks[target] : RETURN_STUB;
+        assembler.patch32(offset, destination - (offset + 4));
+        if(!linked) this->exits.push_back({target, offset});
+    };
+
+    // A skip falls through to address + 2 when its condition fails, and lands on address + 4 otherwise
+    const auto skip = [&](const uint16_t address, const uint8_t jump_if_not_skipping) {
+        assembler.emit({0x0f, jump_if_not_skipping}); // jcc rel32
+        const auto offset = assembler.offset;
+        assembler.emit32(0);
+        exit_to(address + 2 * OPCODE_SPAN);
+        assembler.patch32(offset, assembler.offset - (offset + 4));
+        exit_to(address + OPCODE_SPAN);
+    };
+
+    uint32_t count = 0;
+    uint16_t address = start;
+    bool open = true;
+    const auto& quirks = profiles[static_cast<size_t>(this->cpu.profile)];
+
+    while(open) {
+        // Instructions straddling the end of ram are left to the interpreter, which wraps the same way
+        if(count == BLOCK_INSTRUCTIONS || address >= ADDRESS_MASK) {
+            if(count == 0) {
+                this->protect(false);
+                this->blocks[start] = INTERPRETED;
+                return INTERPRETED;
+            }
+            exit_to(address);
+            break;
+        }
+
+        const auto instruction = CPU::decode((this->cpu.state.ram[address] << 8) | this->cpu.state.ram[address + 1]);
+        const auto x = instruction.x;
+        const auto y = instruction.y;
+        const auto nn = instruction.nn;
+        const auto nnn = instruction.nnn;
+        // Quirks are settled here, so translated code is as specialized as the interpreter's loop
+        const auto shifted = quirks.shift_vy ? y : x;
+
+        switch(instruction.operation) {
+            case Operation::SYS: break;
+
+            case Operation::LD_BYTE: assembler.emit({0xc6, 0x47, x, nn}); break; // mov byte [rdi + x], nn
+            case Operation::ADD_BYTE: assembler.emit({0x80, 0x47, x, nn}); break; // add byte [rdi + x], nn
+
+            case Operation::LD_REGISTER: assembler.load_eax(y); assembler.store_al(x); break;
+            case Operation::OR: assembler.load_eax(y); assembler.emit({0x08, 0x47, x}); break; // or byte [rdi + x], al
+            case Operation::AND: assembler.load_eax(y); assembler.emit({0x20, 0x47, x}); break; // and byte [rdi + x], al
+            case Operation::XOR: assembler.load_eax(y); assembler.emit({0x30, 0x47, x}); break; // xor byte [rdi + x], al
+
+            case Operation::ADD_REGISTER: {
+                assembler.load_eax(x);
+                assembler.load_ecx(y);
+                assembler.emit({0x01, 0xc8}); // add eax, ecx
+                assembler.emit({0x3d, 0xff, 0x00, 0x00, 0x00}); // cmp eax, 0xff
+                assembler.emit({0x41, 0x0f, 0x93, 0xc0}); // setae r8b
+                assembler.store_al(x);
+                assembler.store_flag();
+            } break;
+
+            case Operation::SUB: {
+                assembler.load_eax(x);
+                assembler.load_ecx(y);
+                assembler.emit({0x39, 0xc8}); // cmp eax, ecx
+                assembler.emit({0x41, 0x0f, 0x93, 0xc0}); // setae r8b
+                assembler.emit({0x29, 0xc8}); // sub eax, ecx
+                assembler.store_al(x);
+                assembler.store_flag();
+            } break;
+
+            case Operation::SHR: {
+                assembler.load_eax(shifted);
+                assembler.emit({0x41, 0x89, 0xc0}); // mov r8d, eax
+                assembler.emit({0x41, 0x83, 0xe0, 0x01}); // and r8d, 1
+                assembler.emit({0xd1, 0xe8}); // shr eax, 1
+                assembler.store_al(x);
+                assembler.store_flag();
+            } break;
+
+            case Operation::SUBN: {
+                // The interpreter compares against the already updated Vx, so both are reloaded
+                assembler.load_eax(y);
+                assembler.load_ecx(x);
+                assembler.emit({0x29, 0xc8}); // sub eax, ecx
+                assembler.store_al(x);
+                assembler.load_eax(y);
+                assembler.load_ecx(x);
+                assembler.emit({0x39, 0xc8}); // cmp eax, ecx
+                assembler.emit({0x41, 0x0f, 0x97, 0xc0}); // seta r8b
+                assembler.store_flag();
+            } break;
+
+            case Operation::SHL: {
+                assembler.load_eax(shifted);
+                assembler.emit({0x41, 0x89, 0xc0}); // mov r8d, eax
+                assembler.emit({0x41, 0xc1, 0xe8, 0x07}); // shr r8d, 7
+                assembler.emit({0x01, 0xc0}); // add eax, eax
+                assembler.store_al(x);
+                assembler.store_flag();
+            } break;
+
+            case Operation::LD_I: assembler.emit({0x66, 0xc7, 0x06, static_cast<uint8_t>(nnn & 0xff), static_cast<uint8_t>(nnn >> 8)}); break; // mov word [rsi], nnn
+            case Operation::ADD_I: assembler.load_eax(x); assembler.emit({0x66, 0x01, 0x06}); break; // add word [rsi], ax
+
+            case Operation::LD_F: {
+                assembler.load_eax(x);
+                assembler.emit({0x8d, 0x04, 0x80}); // lea eax, [rax + rax * 4]
+                assembler.emit({0x66, 0x89, 0x06}); // mov word [rsi], ax
+            } break;
+
+            case Operation::JP: exit_to(nnn); open = false; break;
+
+            case Operation::SE_BYTE: {
+                assembler.emit({0x80, 0x7f, x, nn}); // cmp byte [rdi + x], nn
+                skip(address, 0x85); // jne
+                open = false;
+            } break;
+
+            case Operation::SNE_BYTE: {
+                assembler.emit({0x80, 0x7f, x, nn}); // cmp byte [rdi + x], nn
+                skip(address, 0x84); // je
+                open = false;
+            } break;
+
+            case Operation::SE_REGISTER: {
+                assembler.load_eax(x);
+                assembler.emit({0x3a, 0x47, y}); // cmp al, byte [rdi + y]
+                skip(address, 0x85); // jne
+                open = false;
+            } break;
+
+            case Operation::SNE_REGISTER: {
+                assembler.load_eax(x);
+                assembler.emit({0x3a, 0x47, y}); // cmp al, byte [rdi + y]
+                skip(address, 0x84); // je
+                open = false;
+            } break;
+
+            // Everything else touches state the block does not hold, so the block ends right before it
+            default: {
+                if(count == 0) {
+                    this->protect(false);
+                    this->blocks[start] = INTERPRETED;
+                    return INTERPRETED;
+                }
+                exit_to(address);
+                open = false;
+                continue;
+            }
+        }
+
+        this->covered[address] = true;
+        this->covered[address + 1] = true;
+        address += OPCODE_SPAN;
+        count++;
+    }
+
+    assembler.patch32(count_check, count);
+    assembler.patch32(count_subtract, count);
+
+    const auto block = static_cast<int32_t>(this->code_used);
+    this->blocks[start] = block;
+    this->code_used = assembler.offset;
+
+    // Chain every exit that was waiting for this block
+    std::erase_if(this->exits, [&](const Exit& exit) {
+        if(exit.target != start) return false;
+        assembler.patch32(exit.offset, block - (exit.offset + 4));
+        return true;
+    });
+
+    this->protect(false);
+    return block;
+}
+
+FaultStatus JIT::run(uint64_t cycles) {
+    if(this->code == nullptr) return this->cpu.run(cycles);
+
+    const auto requested = cycles;
+    while(cycles > 0 && this->cpu.fault.fault == Fault::NONE) {
+        const auto pc = this->cpu.state.pc;
+        auto block = (pc <= ADDRESS_MASK) ? this->blocks[pc] : INTERPRETED;
+        if(block == NOT_TRANSLATED) block = this->translate(pc);
+
+        if(block == INTERPRETED) {
+            this->interpret();
+            if(this->cpu.fault.fault != Fault::NONE) break;
+            cycles--;
+            // FX07 and FX0A are always interpreted, so this is where idle loops are entered
+            cycles -= this->cpu.idle_cycles(cycles);
+            continue;
+        }
+
+        const auto entry = reinterpret_cast<Block>(this->code + block);
+        const auto result = entry(this->cpu.state.v, &this->cpu.state.i, &cycles);
+        this->cpu.state.pc = result & 0xffff;
+
+        // Fewer cycles are left than the next block holds. They are all inside its straight-line body, which
+        // never stores into ram nor reaches the block's terminator, so the interpreter can run them unchecked
+        if(result & BAIL) {
+            this->cpu.run(cycles);
+            cycles = 0;
+        }
+    }
+    return this->cpu.stopped(requested - cycles);
+}
+
+#undef JIT_HOST
+#undef CODE_SIZE
+#undef BLOCK_INSTRUCTIONS
+#undef BLOCK_BYTES
+#undef ADDRESS_MASK
+#undef OPCODE_SPAN
+#undef BAIL
+#undef NOT_TRANSLATED
+#undef INTERPRETED
+#undef RETURN_STUB
@@ -0,0 +1,514 @@
+#include <algorithm>
+#include <bit>
+#include <bitset>
+#include <cstdint>
+
+#include "lockstep.h"
+
+#define OPCODE_SPAN 2
+#define ADDRESS_MASK 0x0fff
+#define BYTES_PER_FONT 5
+#define RAM_SIZE 4096
+#define WIDE_SPRITE_BYTES 32
+
+static bool vectorized(const Operation);
+static bool in_bounds(const uint16_t, const size_t);
+
+template<size_t N>
+Lockstep<N>::Lockstep() : lanes(std::make_unique<CPU[]>(N)), blocked(0), faulted(0), quirks(profiles[static_cast<size_t>(Profile::REFERENCE)]), converged(false) {}
+
+template<size_t N>
+void Lockstep<N>::init(const uint64_t seed) {
+    for(size_t lane = 0; lane < N; lane++) {
+        this->lanes[lane].init(seed + lane);
+        this->reload(lane, ALL_REGISTERS);
+    }
+
+    this->written.reset();
+    this->blocked = 0;
+    this->faulted = 0;
+    this->quirks = profiles[static_cast<size_t>(Profile::REFERENCE)];
+    this->converged = false;
+}
+
+template<size_t N>
+void Lockstep<N>::set_profile(const Profile profile) {
+    for(size_t lane = 0; lane < N; lane++) this->lanes[lane].set_profile(profile);
+    this->quirks = profiles[static_cast<size_t>(profile)];
+}
+
+template<size_t N>
+void Lockstep<N>::load(const std::span<const uint8_t> rom) {
+    // Every lane gets identical code, which this->written relies on
+    for(size_t lane = 0; lane < N; lane++) this->lanes[lane].load(rom);
+}
+
+template<size_t N>
+void Lockstep<N>::set_key(const size_t lane, const uint8_t key, const bool pressed) {
+    this->lanes[lane].set_key(key, pressed);
+}
+
+template<size_t N>
+void Lockstep<N>::run(uint64_t cycles) {
+    // Keys may have changed since the last call, which may unblock FX0A
+    this->blocked = 0;
+    this->converged = false;
+    for(size_t lane = 0; lane < N; lane++) this->keys[lane] = this->lanes[lane].state.keys;
+
+    for(; cycles > 0; cycles--) {
+        const auto running = ALL & ~this->faulted & ~this->blocked;
+        if(running == 0) return;
+        this->step(running);
+    }
+}
+
+template<size_t N>
+void Lockstep<N>::tick() {
+    for(size_t lane = 0; lane < N; lane++) {
+        // Faulted lanes stay as they were when they stopped
+        if((this->faulted >> lane) & 0x01) continue;
+        auto& cpu = this->lanes[lane];
+        cpu.state.dt = this->dt[lane];
+        cpu.tick();
+        this->dt[lane] = cpu.state.dt;
+    }
+}
+
+template<size_t N>
+const CPU& Lockstep<N>::get_lane(const size_t lane) {
+    this->store(lane, ALL_REGISTERS);
+    return this->lanes[lane];
+}
+
+template<size_t N>
+const FaultStatus& Lockstep<N>::get_fault(const size_t lane) const {
+    return this->lanes[lane].get_fault();
+}
+
+template<size_t N>
+void Lockstep<N>::step(const uint64_t running) {
+    auto pending = running;
+    // Stays true only if a single group ran an instruction that moves every lane to the same address
+    auto together = true;
+
+    // Lanes sorted by address in a single pass, as diverged lanes usually sit at a handful of them
+    uint16_t addresses[N];
+    uint64_t groups[N];
+    size_t count = 0;
+    if(!this->converged) {
+        // Lanes that branched all the same way are still together
+        uint16_t differing = 0;
+        for(size_t lane = 0; lane < N; lane++) differing |= this->pc[lane] ^ this->pc[0];
+        this->converged = (differing == 0);
+    }
+    if(!this->converged) {
+        for(auto lanes = pending; lanes != 0; lanes &= lanes - 1) {
+            const auto lane = std::countr_zero(lanes);
+            size_t index = 0;
+            while(index < count && addresses[index] != this->pc[lane]) index++;
+            if(index == count) {
+                addresses[count] = this->pc[lane];
+                groups[count++] = 0;
+            }
+            groups[index] |= uint64_t{1} << lane;
+        }
+    }
+
+    while(pending != 0) {
+        const auto leader = std::countr_zero(pending);
+        const auto address = this->pc[leader];
+
+        auto group = pending;
+        if(!this->converged) {
+            size_t index = 0;
+            while(addresses[index] != address) index++;
+            group &= groups[index];
+        }
+
+        // Lanes can only hold different opcodes at addresses one of them wrote to
+        const auto opcode = this->opcode_at(leader, address);
+        const auto overwritten = this->written[address & ADDRESS_MASK] || this->written[(address + 1) & ADDRESS_MASK];
+        auto unchecked = overwritten ? group : 0;
+        while(unchecked != 0) {
+            const auto lane = std::countr_zero(unchecked);
+            if(this->opcode_at(lane, address) != opcode) group &= ~(uint64_t{1} << lane);
+            unchecked &= unchecked - 1;
+        }
+        pending &= ~group;
+        together &= (group == running);
+
+        auto& entry = this->lanes[leader].decoded[address & ADDRESS_MASK];
+        if(entry.operation == Operation::UNDECODED) entry = CPU::decode(opcode);
+        const auto instruction = entry;
+
+        auto executed = false;
+        if(group == ALL) {
+            executed = this->execute<false>(instruction, address);
+        } else if(vectorized(instruction.operation)) {
+            for(size_t lane = 0; lane < N; lane++) {
+                this->active[lane] = ((group >> lane) & 0x01) ? 0xff : 0;
+                this->active_wide[lane] = ((group >> lane) & 0x01) ? 0xffff : 0;
+            }
+            executed = this->execute<true>(instruction, address);
+        }
+        if(executed) {
+            // Skips and JP V0 may send each lane somewhere else
+            const auto operation = instruction.operation;
+            together &= (operation != Operation::SE_BYTE && operation != Operation::SNE_BYTE && operation != Operation::SE_REGISTER
+                && operation != Operation::SNE_REGISTER && operation != Operation::SKP && operation != Operation::SKNP && operation != Operation::JP_V0);
+            continue;
+        }
+        if(instruction.operation == Operation::DRW) {
+            this->draw(instruction, group);
+            continue;
+        }
+        if(instruction.operation == Operation::LD_VX_MEMORY) {
+            this->load_registers(instruction, group);
+            continue;
+        }
+
+        if(instruction.operation == Operation::LD_B || instruction.operation == Operation::LD_MEMORY_VX) {
+            const size_t length = (instruction.operation == Operation::LD_B) ? 3 : instruction.x + 1;
+            // Lanes usually write to the same addresses, which only have to be marked once
+            size_t previous = SIZE_MAX;
+            for(auto lanes = group; lanes != 0; lanes &= lanes - 1) {
+                const size_t begin = this->i[std::countr_zero(lanes)];
+                if(begin == previous) continue;
+                previous = begin;
+                for(auto address = begin; address < std::min(begin + length, this->written.size()); address++) this->written.set(address);
+            }
+        }
+        if(instruction.operation == Operation::LD_MEMORY_VX) {
+            this->store_registers(instruction, group);
+            continue;
+        }
+
+        // The lanes' CPUs only get the registers the remaining instructions may use, the others would be copied back and forth for nothing
+        const uint16_t registers = (1 << instruction.x) | (1 << instruction.y) | (1 << 0xf);
+        for(auto lanes = group; lanes != 0; lanes &= lanes - 1) this->execute_lane(std::countr_zero(lanes), registers);
+        together = false;
+    }
+
+    this->converged = together;
+}
+
+template<size_t N>
+template<bool MASKED>
+bool Lockstep<N>::execute(const Instruction& instruction, const uint16_t address) {
+    auto& vx = this->v[instruction.x];
+    auto& vy = this->v[instruction.y];
+    auto& vf = this->v[0xf];
+    const uint16_t next = address + OPCODE_SPAN;
+    const uint16_t skipped = next + OPCODE_SPAN;
+    // Results are computed for every lane first and written in the order the interpreter writes them, as VF may also be Vx or Vy
+    alignas(64) uint8_t result[N];
+    alignas(64) uint8_t flag[N];
+    alignas(64) uint16_t target[N];
+
+    // Every lane runs the same loop with no branch on its data, leaving the lanes outside this->active as they were
+    const auto assign = [this](uint8_t (&row)[N], const uint8_t (&values)[N]) {
+        for(size_t lane = 0; lane < N; lane++) {
+            row[lane] = MASKED ? ((values[lane] & this->active[lane]) | (row[lane] & ~this->active[lane])) : values[lane];
+        }
+    };
+    const auto assign_wide = [this](uint16_t (&row)[N], const uint16_t (&values)[N]) {
+        for(size_t lane = 0; lane < N; lane++) {
+            row[lane] = MASKED ? ((values[lane] & this->active_wide[lane]) | (row[lane] & ~this->active_wide[lane])) : values[lane];
+        }
+    };
+
+    switch(instruction.operation) {
+        case Operation::SYS: break;
+
+        case Operation::JP:
+        case Operation::LD_I:
+        {
+            for(size_t lane = 0; lane < N; lane++) target[lane] = instruction.nnn;
+            assign_wide((instruction.operation == Operation::JP) ? this->pc : this->i, target);
+            // The program counter is already where it has to be
+            if(instruction.operation == Operation::JP) return true;
+        } break;
+
+        case Operation::JP_V0:
+        {
+            const auto& offset = this->quirks.jump_vx ? vx : this->v[0];
+            for(size_t lane = 0; lane < N; lane++) target[lane] = instruction.nnn + offset[lane];
+            assign_wide(this->pc, target);
+        } return true;
+
+        case Operation::SE_BYTE:
+        case Operation::SNE_BYTE:
+        case Operation::SE_REGISTER:
+        case Operation::SNE_REGISTER:
+        {
+            const auto register_operand = (instruction.operation == Operation::SE_REGISTER || instruction.operation == Operation::SNE_REGISTER);
+            const auto equal = (instruction.operation == Operation::SE_BYTE || instruction.operation == Operation::SE_REGISTER);
+            for(size_t lane = 0; lane < N; lane++) {
+                const auto operand = register_operand ? vy[lane] : instruction.nn;
+                target[lane] = ((vx[lane] == operand) == equal) ? skipped : next;
+            }
+            assign_wide(this->pc, target);
+        } return true;
+
+        case Operation::SKP:
+        case Operation::SKNP:
+        {
+            const auto pressed = (instruction.operation == Operation::SKP);
+            for(size_t lane = 0; lane < N; lane++) {
+                const auto key = vx[lane];
+                target[lane] = ((key <= 0xf && ((this->keys[lane] >> (key & 0xf)) & 0x01)) == pressed) ? skipped : next;
+            }
+            assign_wide(this->pc, target);
+        } return true;
+
+        case Operation::LD_VX_DT:
+        {
+            for(size_t lane = 0; lane < N; lane++) result[lane] = this->dt[lane];
+            assign(vx, result);
+        } break;
+
+        case Operation::LD_DT_VX:
+        {
+            for(size_t lane = 0; lane < N; lane++) result[lane] = vx[lane];
+            assign(this->dt, result);
+        } break;
+
+        case Operation::LD_BYTE:
+        {
+            for(size_t lane = 0; lane < N; lane++) result[lane] = instruction.nn;
+            assign(vx, result);
+        } break;
+
+        case Operation::ADD_BYTE:
+        {
+            for(size_t lane = 0; lane < N; lane++) result[lane] = vx[lane] + instruction.nn;
+            assign(vx, result);
+        } break;
+
+        case Operation::LD_REGISTER:
+        {
+            for(size_t lane = 0; lane < N; lane++) result[lane] = vy[lane];
+            assign(vx, result);
+        } break;
+
+        case Operation::OR:
+        {
+            for(size_t lane = 0; lane < N; lane++) result[lane] = vx[lane] | vy[lane];
+            assign(vx, result);
+        } break;
+
+        case Operation::AND:
+        {
+            for(size_t lane = 0; lane < N; lane++) result[lane] = vx[lane] & vy[lane];
+            assign(vx, result);
+        } break;
+
+        case Operation::XOR:
+        {
+            for(size_t lane = 0; lane < N; lane++) result[lane] = vx[lane] ^ vy[lane];
+            assign(vx, result);
+        } break;
+
+        case Operation::ADD_REGISTER:
+        {
+            for(size_t lane = 0; lane < N; lane++) {
+                flag[lane] = ((vx[lane] + vy[lane]) >= 0xff);
+                result[lane] = vx[lane] + vy[lane];
+            }
+            assign(vx, result);
+            assign(vf, flag);
+        } break;
+
+        case Operation::SUB:
+        {
+            for(size_t lane = 0; lane < N; lane++) {
+                flag[lane] = (vx[lane] >= vy[lane]);
+                result[lane] = vx[lane] - vy[lane];
+            }
+            assign(vx, result);
+            assign(vf, flag);
+        } break;
+
+        case Operation::SHR:
+        {
+            const auto& source = this->quirks.shift_vy ? vy : vx;
+            for(size_t lane = 0; lane < N; lane++) {
+                flag[lane] = source[lane] & 0x01;
+                result[lane] = source[lane] >> 1;
+            }
+            assign(vx, result);
+            assign(vf, flag);
+        } break;
+
+        case Operation::SUBN:
+        {
+            for(size_t lane = 0; lane < N; lane++) result[lane] = vy[lane] - vx[lane];
+            assign(vx, result);
+            // Compares against the written Vx, like the interpreter
+            for(size_t lane = 0; lane < N; lane++) flag[lane] = (vy[lane] > vx[lane]);
+            assign(vf, flag);
+        } break;
+
+        case Operation::SHL:
+        {
+            const auto& source = this->quirks.shift_vy ? vy : vx;
+            for(size_t lane = 0; lane < N; lane++) {
+                flag[lane] = (source[lane] & 0x80) ? 1 : 0;
+                result[lane] = source[lane] << 1;
+            }
+            assign(vx, result);
+            assign(vf, flag);
+        } break;
+
+        case Operation::ADD_I:
+        {
+            for(size_t lane = 0; lane < N; lane++) target[lane] = this->i[lane] + vx[lane];
+            assign_wide(this->i, target);
+        } break;
+
+        case Operation::LD_F:
+        {
+            for(size_t lane = 0; lane < N; lane++) target[lane] = vx[lane] * BYTES_PER_FONT;
+            assign_wide(this->i, target);
+        } break;
+
+        default: return false;
+    }
+
+    for(size_t lane = 0; lane < N; lane++) target[lane] = next;
+    assign_wide(this->pc, target);
+    return true;
+}
+
+template<size_t N>
+void Lockstep<N>::draw(const Instruction& instruction, const uint64_t group) {
+    // DXY0 draws 16 rows of 16 pixels, like CPU::op_drw
+    const auto wide = this->quirks.extended && instruction.n == 0;
+    const size_t length = wide ? WIDE_SPRITE_BYTES : instruction.n;
+    for(auto lanes = group; lanes != 0; lanes &= lanes - 1) {
+        const auto lane = std::countr_zero(lanes);
+        auto& state = this->lanes[lane].state;
+        if(!in_bounds(this->i[lane], length)) {
+            this->execute_lane(lane, 0);
+            continue;
+        }
+
+        const auto sprite = std::span<const uint8_t>(state.ram + this->i[lane], length);
+
+        const auto x = this->v[instruction.x][lane];
+        const auto y = this->v[instruction.y][lane];
+        this->v[0xf][lane] = this->quirks.clip ? state.framebuffer.draw_sprite<true>(x, y, sprite, wide) : state.framebuffer.draw_sprite<false>(x, y, sprite, wide);
+        this->pc[lane] += OPCODE_SPAN;
+    }
+}
+
+template<size_t N>
+void Lockstep<N>::load_registers(const Instruction& instruction, const uint64_t group) {
+    for(auto lanes = group; lanes != 0; lanes &= lanes - 1) {
+        const auto lane = std::countr_zero(lanes);
+        const auto& state = this->lanes[lane].state;
+        if(!in_bounds(this->i[lane], instruction.x + 1)) {
+            this->execute_lane(lane, 0);
+            continue;
+        }
+
+        for(size_t index = 0; index <= instruction.x; index++) {
+            const auto value = state.ram[this->i[lane] + index];
+            if(this->v[index][lane] != value) this->v[index][lane] = value;
+        }
+        if(this->quirks.increment_i) this->i[lane] += instruction.x + 1;
+        this->pc[lane] += OPCODE_SPAN;
+    }
+}
+
+template<size_t N>
+void Lockstep<N>::store_registers(const Instruction& instruction, const uint64_t group) {
+    for(auto lanes = group; lanes != 0; lanes &= lanes - 1) {
+        const auto lane = std::countr_zero(lanes);
+        auto& cpu = this->lanes[lane];
+        if(!in_bounds(this->i[lane], instruction.x + 1)) {
+            this->execute_lane(lane, 0);
+            continue;
+        }
+
+        for(size_t index = 0; index <= instruction.x; index++) {
+            cpu.state.ram[this->i[lane] + index] = this->v[index][lane];
+        }
+        cpu.invalidate(this->i[lane], instruction.x + 1);
+        if(this->quirks.increment_i) this->i[lane] += instruction.x + 1;
+        this->pc[lane] += OPCODE_SPAN;
+    }
+}
+
+template<size_t N>
+void Lockstep<N>::execute_lane(const size_t lane, const uint16_t registers) {
+    auto& cpu = this->lanes[lane];
+    this->store(lane, registers);
+    cpu.cycle();
+    this->reload(lane, registers);
+
+    if(cpu.fault.fault != Fault::NONE) this->faulted |= uint64_t{1} << lane;
+
+    if(cpu.state.blocked) this->blocked |= uint64_t{1} << lane;
+}
+
+template<size_t N>
+uint16_t Lockstep<N>::opcode_at(const size_t lane, const uint16_t address) const {
+    const auto& ram = this->lanes[lane].state.ram;
+    return (ram[address & ADDRESS_MASK] << 8) | ram[(address + 1) & ADDRESS_MASK];
+}
+
+template<size_t N>
+void Lockstep<N>::store(const size_t lane, const uint16_t registers) {
+    auto& state = this->lanes[lane].state;
+    for(auto remaining = registers; remaining != 0; remaining &= remaining - 1) {
+        const auto x = std::countr_zero(remaining);
+        state.v[x] = this->v[x][lane];
+    }
+    state.i = this->i[lane];
+    state.pc = this->pc[lane];
+    state.dt = this->dt[lane];
+}
+
+template<size_t N>
+void Lockstep<N>::reload(const size_t lane, const uint16_t registers) {
+    const auto& state = this->lanes[lane].state;
+    // Most instructions change one register at most. Storing only those keeps the vector loads of the next instructions from stalling on the other rows
+    for(auto remaining = registers; remaining != 0; remaining &= remaining - 1) {
+        const auto x = std::countr_zero(remaining);
+        if(this->v[x][lane] != state.v[x]) this->v[x][lane] = state.v[x];
+    }
+    this->i[lane] = state.i;
+    this->pc[lane] = state.pc;
+    this->dt[lane] = state.dt;
+}
+
+// Whether Lockstep::execute handles the provided operation, so preparing its masks is not wasted
+static bool vectorized(const Operation operation) {
+    switch(operation) {
+        case Operation::SYS: case Operation::JP: case Operation::LD_I: case Operation::JP_V0:
+        case Operation::SE_BYTE: case Operation::SNE_BYTE: case Operation::SE_REGISTER: case Operation::SNE_REGISTER:
+        case Operation::SKP: case Operation::SKNP: case Operation::LD_VX_DT: case Operation::LD_DT_VX:
+        case Operation::LD_BYTE: case Operation::ADD_BYTE: case Operation::LD_REGISTER: case Operation::OR: case Operation::AND:
+        case Operation::XOR: case Operation::ADD_REGISTER: case Operation::SUB: case Operation::SHR: case Operation::SUBN:
+        case Operation::SHL: case Operation::ADD_I: case Operation::LD_F:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Same check as CPU::in_bounds, for a lane's I
+static bool in_bounds(const uint16_t address, const size_t length) {
+    return address + length <= RAM_SIZE;
+}
+
+template struct Lockstep<16>;
+template struct Lockstep<32>;
+template struct Lockstep<64>;
+
+#undef OPCODE_SPAN
+#undef ADDRESS_MASK
+#undef BYTES_PER_FONT
+#undef RAM_SIZE
+#undef WIDE_SPRITE_BYTES
@@ -1,67 +1,535 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <format>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
 
+#include "audio.h"
+#include "batch.h"
+#include "capture.h"
+#include "gpu.h"
+#include "input.h"
+#include "jit.h"
 #include "octopus.h"
+#include "profiler.h"
+#include "quirks.h"
+#include "recording.h"
+#include "rewind.h"
+#include "rom.h"
+#include "runahead.h"
+#include "savestate.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "trace.h"
 
-#define KEY_UP 1
-#define KEY_DOWN 0
+#define DEFAULT_INSTRUCTIONS_PER_FRAME 10
+// Bytes of rewind history, enough for well over a minute of frames in most ROMs
+#define REWIND_CAPACITY (512 * 1024)
+// Inputs the render thread can get ahead of the emulation thread by, far more than a frame's worth of events
+#define INPUT_QUEUE_SIZE 256
+// Instructions the trace keeps, the last 1M before the dump
+#define TRACE_CAPACITY (1 << 20)
 
-#define CLOCK_HZ (1000 / 60)
+struct Options {
+    std::string rom_path;
+    // \brief Runs without a window, drawing only into the CPU's in-memory framebuffer
+    bool headless = false;
+    // \brief Amount of cycles to emulate in headless mode. 0 means forever
+    uint64_t cycles = 0;
+    // \brief Runs the recompiling core instead of the interpreter
+    bool jit = false;
+    // \brief Instruction cycles per 60 Hz frame
+    uint32_t instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+    // \brief Runs frames back to back instead of pacing them at 60 Hz. Headless mode is always unthrottled
+    bool unthrottled = false;
+    // \brief File listing the jobs to run headless in parallel instead of a single ROM
+    std::string batch_path;
+    // \brief Worker threads for batch mode
+    size_t threads = std::thread::hardware_concurrency();
+    // \brief Seed of the generator behind RND. Random unless provided, pass the same one to reproduce a run
+    uint64_t seed = std::random_device{}();
+    // \brief File of key events to replay in headless mode
+    std::string input_path;
+    // \brief File to record the windowed session into
+    std::string record_path;
+    // \brief Recorded session to replay headless instead of running the ROM
+    std::string replay_path;
+    // \brief File to write the profile of the run into, as JSON
+    std::string profile_path;
+    // \brief File to dump the last traced instructions into once the run ends or faults
+    std::string trace_path;
+    // \brief Quirks the ROM runs with. Unless provided, looked up in the database at this->quirks_path by the ROM's hash, or Profile::REFERENCE if it is not listed
+    Profile profile = Profile::REFERENCE;
+    // \brief Whether --quirks picked this->profile, which then wins over the database
+    bool profile_given = false;
+    // \brief Database of the profiles of known ROMs, see find_profile
+    std::string quirks_path;
+    // \brief File or "tcp://HOST:PORT" viewer to stream the frames DRW or CLS changed to, see Capture
+    std::string capture_path;
+    // \brief Frames to run past the current one before presenting, rolling back afterwards, so a ROM's reaction to a key shows that many frames earlier. 0 disables it
+    uint32_t run_ahead = 0;
+    // \brief Fades pixels out over a few frames once turned off, like a CRT's phosphors, instead of at once
+    bool phosphor = false;
+    // \brief FNV-1a hash of the loaded ROM, filled in once it is read since stdin cannot be read twice
+    uint64_t rom_hash = 0;
+};
 
+// \brief What runs the instructions: the CPU's interpreter, optionally through a profiling or tracing policy, or the JIT
+struct Core {
+    CPU& processor;
+    JIT* recompiler;
+    Profiler* profiler;
+    Tracer* tracer;
+};
+
+// \brief What the render thread forwards to the emulation thread
+struct Input {
+    enum class Kind : uint8_t { KEY, REWIND, SAVE_STATE, LOAD_STATE, TOGGLE_TRACE, QUIT };
+
+    Kind kind;
+    // \brief The CHIP-8 key, for Kind::KEY
+    uint8_t key;
+    // \brief Whether the key was pressed or released, for Kind::KEY and Kind::REWIND
+    bool pressed;
+};
+
+// \brief What the emulation and render threads share in windowed mode. Neither side ever waits on the other through it
+struct Link {
+    SpscQueue<Input, INPUT_QUEUE_SIZE> inputs;
+    // \brief The latest framebuffer that DRW or CLS changed
+    TripleBuffer<Framebuffer> frames;
+    // \brief Cleared by the emulation thread once it stops, after Kind::QUIT or a fault
+    std::atomic<bool> running = true;
+};
+
+bool parse_options(const int32_t, char* [], Options&);
+int32_t run_batch_file(const Options&);
+int32_t run_replay(Core&, const Options&, const Recording&);
+FaultStatus run_cycles(Core&, const uint64_t);
+void report(const FaultStatus&);
+void restore(Core&, const State&);
+void handle_state(Core&, const Options&, const Input::Kind);
+int32_t run_headless(Core&, const Options&);
+void run_windowed(Core&, const Options&);
+void emulate(Core&, const Options&, Link&, Audio&);
+void handle_event(const sf::Event&, GPU&, Link&);
 int8_t get_key_code(const sf::Keyboard::Key);
 
 int32_t main(int32_t argc, char* argv[]) {
-    if(argc < 2) {
-        std::cout << std::format("Usage: {} [ROM]\n", argv[0]);
+    Options options;
+    if(!parse_options(argc, argv, options)) {
+        std::cout << std::format("Usage: {} [--headless] [--cycles N] [--core=interpreter|jit] [--ipf N] [--unthrottled] [--run-ahead N] [--phosphor] [--batch JOBS --threads N] [--seed N] [--quirks=reference|chip8|schip|xochip] [--quirks-db FILE] [--input FILE] [--record FILE | --replay FILE] [--profile FILE | --trace FILE] [--capture FILE|tcp://HOST:PORT] [ROM]\n", argv[0]);
         return 1;
     }
 
-    const auto file_path = std::string(argv[1]);
+    if(!options.batch_path.empty()) return run_batch_file(options);
 
-    GPU graphics_handler;
-    CPU processor(graphics_handler);
-    processor.init();
-    processor.dump_into_memory(file_path);
+    // The recorded seed and quirks are needed before the CPU is initialized
+    Recording replay;
+    if(!options.replay_path.empty()) {
+        read_recording(options.replay_path, replay);
+        options.seed = replay.seed;
+        options.profile = replay.profile;
+        options.profile_given = true;
+    }
 
-    auto& screen = graphics_handler.init();
-    auto clock_previous = std::chrono::steady_clock::now();
+    CPU processor;
+    processor.init(options.seed);
+    {
+        const RomImage rom(options.rom_path);
+        processor.load(rom.bytes());
+        options.rom_hash = hash_rom(rom.bytes());
+    }
+    if(!options.profile_given && !options.quirks_path.empty()) find_profile(options.quirks_path, options.rom_hash, options.profile);
+    processor.set_profile(options.profile);
 
-    while(true) {
-        const auto clock_now = std::chrono::steady_clock::now();
+    // Both see every instruction, which translated blocks cannot report, so they always run the interpreter
+    std::unique_ptr<Profiler> profiler;
+    std::unique_ptr<Tracer> tracer;
+    if(!options.profile_path.empty() || !options.trace_path.empty()) {
+        if(options.jit) std::cerr << "jit: cannot be profiled or traced, running the interpreter instead\n";
+        options.jit = false;
+        if(!options.profile_path.empty()) profiler = std::make_unique<Profiler>();
+        if(!options.trace_path.empty()) tracer = std::make_unique<Tracer>(TRACE_CAPACITY);
+    }
 
-        sf::Event event;
-        while(screen.pollEvent(event)) {
-            switch(event.type) {
-                case sf::Event::Closed: exit(0); break;
-                case sf::Event::KeyPressed: {
-                    const auto key_code = get_key_code(event.key.code);
-                    if(!processor.keys.contains(key_code)) break;
-                    processor.keys[key_code] = KEY_UP;
-                } break;
-                case sf::Event::KeyReleased: {
-                    const auto key_code = get_key_code(event.key.code);
-                    if(!processor.keys.contains(key_code)) break;
-                    processor.keys[key_code] = KEY_DOWN;
-                } break;
-                default: break;
-            }
+    std::unique_ptr<JIT> recompiler;
+    if(options.jit) {
+        if(!JIT::supported()) std::cerr << "jit: host not supported, falling back to the interpreter\n";
+        recompiler = std::make_unique<JIT>(processor);
+    }
+
+    Core core{processor, recompiler.get(), profiler.get(), tracer.get()};
+    int32_t status = 0;
+    try {
+        if(!options.replay_path.empty()) {
+            status = run_replay(core, options, replay);
+        } else if(options.headless) {
+            status = run_headless(core, options);
+        } else {
+            run_windowed(core, options);
         }
+    } catch(const std::exception&) {
+        // Still useful when the run stops on an error, such as an unreadable input file
+        if(tracer != nullptr) tracer->write(options.trace_path);
+        throw;
+    }
 
-        processor.cycle();
-        graphics_handler.draw();
+    if(profiler != nullptr) profiler->write(options.profile_path);
+    if(tracer != nullptr) tracer->write(options.trace_path);
+    return status;
+}
 
-        const auto clock_rate = std::chrono::milliseconds(CLOCK_HZ).count();
-        if(std::chrono::duration_cast<std::chrono::milliseconds>(clock_now - clock_previous).count() > clock_rate) {
-            processor.tick();
-            clock_previous = clock_now;
+bool parse_options(const int32_t argc, char* argv[], Options& options) {
+    for(int32_t index = 1; index < argc; index++) {
+        const auto argument = std::string(argv[index]);
+        if(argument == "--headless") {
+            options.headless = true;
+        } else if(argument == "--cycles") {
+            if(++index == argc) return false;
+            options.cycles = std::stoull(argv[index]);
+        } else if(argument == "--ipf") {
+            if(++index == argc) return false;
+            options.instructions_per_frame = std::stoul(argv[index]);
+        } else if(argument == "--batch") {
+            if(++index == argc) return false;
+            options.batch_path = argv[index];
+        } else if(argument == "--threads") {
+            if(++index == argc) return false;
+            options.threads = std::stoul(argv[index]);
+        } else if(argument == "--record") {
+            if(++index == argc) return false;
+            options.record_path = argv[index];
+        } else if(argument == "--replay") {
+            if(++index == argc) return false;
+            options.replay_path = argv[index];
+        } else if(argument == "--profile") {
+            if(++index == argc) return false;
+            options.profile_path = argv[index];
+        } else if(argument == "--trace") {
+            if(++index == argc) return false;
+            options.trace_path = argv[index];
+        } else if(argument == "--input") {
+            if(++index == argc) return false;
+            options.input_path = argv[index];
+        } else if(argument == "--seed") {
+            if(++index == argc) return false;
+            options.seed = std::stoull(argv[index]);
+        } else if(argument.starts_with("--quirks=")) {
+            if(!parse_profile(argument.substr(std::string("--quirks=").size()), options.profile)) return false;
+            options.profile_given = true;
+        } else if(argument == "--quirks-db") {
+            if(++index == argc) return false;
+            options.quirks_path = argv[index];
+        } else if(argument == "--capture") {
+            if(++index == argc) return false;
+            options.capture_path = argv[index];
+        } else if(argument == "--run-ahead") {
+            if(++index == argc) return false;
+            options.run_ahead = std::stoul(argv[index]);
+        } else if(argument == "--phosphor") {
+            options.phosphor = true;
+        } else if(argument == "--unthrottled") {
+            options.unthrottled = true;
+        } else if(argument == "--core=jit") {
+            options.jit = true;
+        } else if(argument == "--core=interpreter") {
+            options.jit = false;
+        } else if(argument.starts_with("--")) {
+            return false;
+        } else {
+            options.rom_path = argument;
         }
     }
 
+    // Each of them is a policy on the interpreter's loop, and it runs with one at a time
+    if(!options.profile_path.empty() && !options.trace_path.empty()) return false;
+
+    return !options.rom_path.empty() || !options.batch_path.empty();
+}
+
+int32_t run_batch_file(const Options& options) {
+    const auto jobs = read_jobs(options.batch_path, options.seed);
+    const auto results = run_batch(jobs, {options.threads, options.instructions_per_frame, options.jit, options.profile});
+
+    int32_t faults = 0;
+    for(size_t index = 0; index < jobs.size(); index++) {
+        const auto& result = results[index];
+        std::cout << std::format("{} {:016x} {} {}\n", jobs[index].rom_path, result.framebuffer_hash, result.cycles, result.fault.empty() ? "ok" : result.fault);
+        if(!result.fault.empty()) faults++;
+    }
+
+    return (faults == 0) ? 0 : 2;
+}
+
+int32_t run_replay(Core& core, const Options& options, const Recording& recording) {
+    auto& processor = core.processor;
+    if(options.rom_hash != recording.rom_hash) {
+        std::cerr << std::format("replay: {} is not the rom the session was recorded on\n", options.rom_path);
+        return 1;
+    }
+
+    InputQueue input;
+    recording.queue(input);
+    for(uint64_t frame = 0; frame < recording.frames; frame++) {
+        input.apply(processor, frame);
+        // The session ended on the same frame if it faulted
+        const auto fault = run_cycles(core, recording.instructions_per_frame);
+        if(fault.fault != Fault::NONE) {
+            report(fault);
+            break;
+        }
+        processor.tick();
+    }
+
+    const auto hash = processor.hash();
+    if(hash != recording.state_hash) {
+        std::cout << std::format("replay: diverged after {} frames, state {:016x} instead of {:016x}\n", recording.frames, hash, recording.state_hash);
+        return 3;
+    }
+
+    std::cout << std::format("replay: matched after {} frames, state {:016x}\n", recording.frames, hash);
     return 0;
 }
 
+FaultStatus run_cycles(Core& core, const uint64_t cycles) {
+    if(core.profiler != nullptr) {
+        const auto start = std::chrono::steady_clock::now();
+        const auto fault = core.processor.run(cycles, *core.profiler);
+        core.profiler->emulation_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        core.profiler->end_frame();
+        return fault;
+    }
+    if(core.tracer != nullptr) return core.processor.run(cycles, *core.tracer);
+    if(core.recompiler != nullptr) return core.recompiler->run(cycles);
+    return core.processor.run(cycles);
+}
+
+void report(const FaultStatus& fault) {
+    std::cerr << std::format("fault: {} at {:03x}, opcode {:04x}\n", describe(fault.fault), fault.pc, fault.opcode);
+}
+
+void restore(Core& core, const State& state) {
+    if(core.recompiler != nullptr) {
+        core.recompiler->restore(state);
+    } else {
+        core.processor.restore(state);
+    }
+}
+
+void handle_state(Core& core, const Options& options, const Input::Kind kind) {
+    const auto state_path = options.rom_path + ".state";
+    State state;
+
+    try {
+        if(kind == Input::Kind::SAVE_STATE) {
+            core.processor.snapshot(state);
+            write_state(state_path, state);
+        } else {
+            read_state(state_path, state);
+            restore(core, state);
+        }
+    } catch(const std::exception& error) {
+        std::cerr << error.what();
+    }
+}
+
+int32_t run_headless(Core& core, const Options& options) {
+    auto& processor = core.processor;
+    InputQueue input;
+    if(!options.input_path.empty()) read_input(options.input_path, input);
+    std::unique_ptr<Capture> capture;
+    if(!options.capture_path.empty()) capture = std::make_unique<Capture>(options.capture_path);
+
+    const uint64_t frame = options.instructions_per_frame;
+    auto fault = FaultStatus{Fault::NONE, 0, 0};
+    for(uint64_t cycle = 0, index = 0; options.cycles == 0 || cycle < options.cycles; cycle += frame, index++) {
+        input.apply(processor, index);
+        const auto remaining = options.cycles - cycle;
+        fault = run_cycles(core, (options.cycles == 0 || remaining > frame) ? frame : remaining);
+        if(capture != nullptr) {
+            capture->push(processor.get_framebuffer(), index);
+            processor.get_framebuffer().set_clean();
+        }
+        if(fault.fault != Fault::NONE) break;
+        processor.tick();
+    }
+
+    // The framebuffer a faulting ROM left is still worth comparing
+    std::cout << std::format("{:016x}\n", processor.get_framebuffer().hash());
+    if(fault.fault == Fault::NONE) return 0;
+    report(fault);
+    return 2;
+}
+
+void run_windowed(Core& core, const Options& options) {
+    GPU graphics_handler;
+    auto& screen = graphics_handler.init(options.phosphor);
+    Link link;
+    Audio audio;
+    audio.play();
+
+    // This thread owns the window and only presents and forwards input, so a stalled display never holds back emulated time
+    std::thread emulation(emulate, std::ref(core), std::cref(options), std::ref(link), std::ref(audio));
+
+    const auto period = std::chrono::nanoseconds(std::nano::den / Scheduler::FRAME_RATE);
+    auto next_present = std::chrono::steady_clock::now();
+    // Added to the profile once the emulation thread, which owns it until then, has stopped
+    std::chrono::steady_clock::duration presentation{};
+    while(link.running) {
+        sf::Event event;
+        while(screen.pollEvent(event)) handle_event(event, graphics_handler, link);
+
+        // Presents only if DRW or CLS changed something since the last frame shown, or pixels turned off are still fading out, and at most once per 60 Hz period
+        const auto start = std::chrono::steady_clock::now();
+        if(auto* framebuffer = link.frames.read()) {
+            graphics_handler.draw(*framebuffer);
+        } else {
+            graphics_handler.fade();
+        }
+        presentation += std::chrono::steady_clock::now() - start;
+
+        // Never schedules into the past, so a stalled display is not followed by a burst of frames
+        next_present = std::max(next_present + period, std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(next_present);
+    }
+
+    emulation.join();
+    if(core.profiler != nullptr) core.profiler->presentation_seconds += std::chrono::duration<double>(presentation).count();
+}
+
+void handle_event(const sf::Event& event, GPU& graphics_handler, Link& link) {
+    const auto pressed = (event.type == sf::Event::KeyPressed);
+    switch(event.type) {
+        case sf::Event::Closed:
+            // Must not be dropped, and the emulation thread drains the queue at least once per frame
+            while(link.running && !link.inputs.push({Input::Kind::QUIT, 0, false})) std::this_thread::yield();
+            break;
+        case sf::Event::Resized: graphics_handler.resize(event.size.width, event.size.height); break;
+        case sf::Event::GainedFocus: graphics_handler.redraw(); break;
+        case sf::Event::KeyPressed:
+        case sf::Event::KeyReleased: {
+            if(event.key.code == sf::Keyboard::Backspace) link.inputs.push({Input::Kind::REWIND, 0, pressed});
+            if(pressed && event.key.code == sf::Keyboard::F5) link.inputs.push({Input::Kind::SAVE_STATE, 0, true});
+            if(pressed && event.key.code == sf::Keyboard::F9) link.inputs.push({Input::Kind::LOAD_STATE, 0, true});
+            if(pressed && event.key.code == sf::Keyboard::F8) link.inputs.push({Input::Kind::TOGGLE_TRACE, 0, true});
+
+            const auto key_code = get_key_code(event.key.code);
+            if(key_code >= 0) link.inputs.push({Input::Kind::KEY, static_cast<uint8_t>(key_code), pressed});
+        } break;
+        default: break;
+    }
+}
+
+void emulate(Core& core, const Options& options, Link& link, Audio& audio) {
+    auto& processor = core.processor;
+    Scheduler scheduler(options.instructions_per_frame, !options.unthrottled);
+    Rewind history(REWIND_CAPACITY);
+    State state;
+    // Where the emulation really is while frames are run ahead of it
+    State present;
+    InputQueue input;
+    // Frames run so far, which key events are stamped with
+    uint64_t frames = 0;
+    // Whether the frame last presented was drawn in frames run ahead, so it differs from the present one
+    auto predicted = false;
+    auto rewinding = false;
+    auto quit = false;
+
+    const auto recording_session = !options.record_path.empty();
+    Recording recording{};
+    if(recording_session) recording = {options.rom_hash, options.seed, scheduler.instructions_per_frame, options.profile, 0, 0, {}};
+
+    try {
+        std::unique_ptr<Capture> capture;
+        if(!options.capture_path.empty()) capture = std::make_unique<Capture>(options.capture_path);
+
+        while(!quit) {
+            for(Input message; link.inputs.pop(message);) {
+                switch(message.kind) {
+                    case Input::Kind::KEY: input.push({frames, message.key, message.pressed}); break;
+                    // Going back in time would make the recording diverge from the session, so it is off while recording
+                    case Input::Kind::REWIND: rewinding = message.pressed && !recording_session; break;
+                    case Input::Kind::LOAD_STATE: if(recording_session) break; [[fallthrough]];
+                    case Input::Kind::SAVE_STATE: handle_state(core, options, message.kind); break;
+                    case Input::Kind::TOGGLE_TRACE: if(core.tracer != nullptr) core.tracer->enabled = !core.tracer->enabled; break;
+                    case Input::Kind::QUIT: quit = true; break;
+                }
+            }
+            if(quit) break;
+
+            // Nothing would change until a key is pressed, or once faulted until rewinding or loading a state, so sleep until the render thread sends something instead of waking up every frame
+            const auto faulted = (processor.get_fault().fault != Fault::NONE);
+            if((faulted || (processor.is_waiting_for_key() && input.empty())) && !rewinding) {
+                link.inputs.wait();
+                scheduler.restart();
+                continue;
+            }
+
+            const auto due = scheduler.frames_due();
+            if(due == 0) {
+                scheduler.wait();
+                continue;
+            }
+
+            for(uint64_t frame = 0; frame < due; frame++) {
+                // Holding backspace steps back one frame per frame instead of running one
+                if(rewinding) {
+                    if(history.pop(state)) restore(core, state);
+                    continue;
+                }
+
+                if(processor.get_fault().fault != Fault::NONE) break;
+
+                input.apply(processor, frames);
+                if(recording_session) recording.record(frames, processor.get_keys());
+                frames++;
+                const auto fault = run_cycles(core, scheduler.instructions_per_frame);
+                if(fault.fault != Fault::NONE) {
+                    report(fault);
+                    // A recording ends on its fault, the CPU otherwise stays where it stopped until rewound or a state is loaded
+                    quit = recording_session;
+                    break;
+                }
+                // Only frames really run are heard and captured, not the ones rewound over or run ahead
+                audio.push_frame(processor);
+                if(capture != nullptr) capture->push(processor.get_framebuffer(), frames);
+                processor.tick();
+                processor.snapshot(state);
+                history.push(state);
+            }
+
+            auto& framebuffer = processor.get_framebuffer();
+            if(options.run_ahead > 0 && !rewinding && processor.get_fault().fault == Fault::NONE) {
+                predicted = run_ahead(processor, core.recompiler, options.run_ahead, scheduler.instructions_per_frame, present, link.frames, predicted);
+            } else if(framebuffer.is_dirty()) {
+                link.frames.write(framebuffer);
+                framebuffer.set_clean();
+            }
+        }
+    } catch(const std::exception& error) {
+        std::cerr << error.what();
+    }
+
+    // Written after a fault too, as replaying it reproduces the fault
+    if(recording_session) {
+        recording.frames = frames;
+        recording.state_hash = processor.hash();
+        try {
+            write_recording(options.record_path, recording);
+        } catch(const std::exception& error) {
+            std::cerr << error.what();
+        }
+    }
+
+    link.running = false;
+}
+
 int8_t get_key_code(const sf::Keyboard::Key key) {
     switch(key) {
         case sf::Keyboard::Num1: return 0x1;
@@ -84,6 +552,7 @@ int8_t get_key_code(const sf::Keyboard::Key key) {
     }
 }
 
-#undef KEY_UP
-#undef KEY_DOWN
-#undef CLOCK_HZ
+#undef DEFAULT_INSTRUCTIONS_PER_FRAME
+#undef REWIND_CAPACITY
+#undef INPUT_QUEUE_SIZE
+#undef TRACE_CAPACITY
@@ -1,79 +1,179 @@
+#include <algorithm>
+#include <bit>
+#include <cstddef>
 #include <cstring>
 #include <format>
-#include <fstream>
+#include <stdexcept>
+#include <type_traits>
 
 #include "octopus.h"
+#include "profiler.h"
+#include "rom.h"
+#include "trace.h"
 
-#define WIDTH 64
-#define HEIGHT 32
-#define SCALE_FACTOR 10
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
 
-#define ON_COLOR sf::Color(30, 144, 255)
-#define OFF_COLOR sf::Color::Black
+void Framebuffer::clear() {
+    std::memset(this->rows, 0, sizeof this->rows);
+    this->dirty = true;
+}
 
-sf::RenderWindow& GPU::init() {
-    this->active_screen.create(sf::VideoMode(WIDTH * SCALE_FACTOR, HEIGHT * SCALE_FACTOR), "octopus");
+void Framebuffer::set_hires(const bool hires) {
+    this->hires = hires;
+    this->clear();
+}
 
-    this->framebuffer.create(WIDTH, HEIGHT);
-    this->graphics.create(WIDTH, HEIGHT);
+bool Framebuffer::is_hires() const {
+    return this->hires;
+}
 
-    this->drawable_graphics.setScale(SCALE_FACTOR, SCALE_FACTOR);
-    this->drawable_graphics.setTexture(this->graphics);
+uint8_t Framebuffer::get_width() const {
+    return this->hires ? WIDTH : LORES_WIDTH;
+}
 
-    return this->active_screen;
+uint8_t Framebuffer::get_height() const {
+    return this->hires ? HEIGHT : LORES_HEIGHT;
 }
 
-uint8_t GPU::copy_to_framebuffer(const uint8_t default_x, const uint8_t default_y, const std::vector<uint8_t> sprite) {
-    uint8_t overlapping = 0;
+template<bool CLIP>
+uint8_t Framebuffer::draw_sprite(const uint8_t default_x, const uint8_t default_y, const std::span<const uint8_t> sprite, const bool wide) {
+    uint64_t overlapping = 0;
+    const auto rows = wide ? sprite.size() / 2 : sprite.size();
+    // The sprite's row in the top bits of a word, as if it were drawn at x = 0
+    const auto pixels_at = [&](const size_t pixel_y) {
+        if(!wide) return static_cast<uint64_t>(sprite[pixel_y]) << 56;
+        return (static_cast<uint64_t>(sprite[2 * pixel_y]) << 56) | (static_cast<uint64_t>(sprite[2 * pixel_y + 1]) << 48);
+    };
 
-    for(int8_t pixel_y = 0; pixel_y < static_cast<int8_t>(sprite.size()); pixel_y++) {
-        const auto byte = sprite[pixel_y];
-        for(int8_t bit_index = 8; bit_index >= 0; bit_index--) {
-            const int8_t pixel_x = 8 - bit_index;
-            const int8_t current_pixel = (byte >> bit_index) & 0x01;
-            if(current_pixel == 0) continue;
+    // A clipped sprite still starts at the wrapped coordinates, only its pixels past the edges are dropped
+    if(!this->hires) {
+        const auto shift = default_x % LORES_WIDTH;
+        const auto top = default_y % LORES_HEIGHT;
+        const auto visible_rows = CLIP ? std::min<size_t>(rows, LORES_HEIGHT - top) : rows;
 
-            const int8_t x = (default_x + pixel_x) % WIDTH;
-            const int8_t y = (default_y + pixel_y) % HEIGHT;
+        for(size_t pixel_y = 0; pixel_y < visible_rows; pixel_y++) {
+            const auto pixels = pixels_at(pixel_y);
+            const auto bits = CLIP ? (pixels >> shift) : std::rotr(pixels, shift);
+            auto& row = this->rows[0][(top + pixel_y) % LORES_HEIGHT];
 
-            if(this->framebuffer.getPixel(x, y) == OFF_COLOR) {
-                this->framebuffer.setPixel(x, y, ON_COLOR);
+            overlapping |= row & bits;
+            row ^= bits;
+        }
+    } else {
+        const auto shift = default_x % WIDTH;
+        const auto top = default_y % HEIGHT;
+        const auto visible_rows = CLIP ? std::min<size_t>(rows, HEIGHT - top) : rows;
+
+        for(size_t pixel_y = 0; pixel_y < visible_rows; pixel_y++) {
+            const auto pixels = pixels_at(pixel_y);
+            // Both words hold the row as one 128-bit word. A sprite starting in its first half ends before the end of the second
+            uint64_t left = 0;
+            uint64_t right = 0;
+            if(shift < 64) {
+                left = pixels >> shift;
+                if(shift > 0) right = pixels << (64 - shift);
             } else {
-                this->framebuffer.setPixel(x, y, OFF_COLOR);
-                overlapping = 1;
+                right = pixels >> (shift - 64);
+                if(!CLIP && shift > 64) left = pixels << (128 - shift);
             }
+            const auto y = (top + pixel_y) % HEIGHT;
+
+            overlapping |= (this->rows[0][y] & left) | (this->rows[1][y] & right);
+            this->rows[0][y] ^= left;
+            this->rows[1][y] ^= right;
         }
     }
 
-    return overlapping;
+    this->dirty = true;
+    return overlapping != 0;
+}
+
+template uint8_t Framebuffer::draw_sprite<false>(const uint8_t, const uint8_t, const std::span<const uint8_t>, const bool);
+template uint8_t Framebuffer::draw_sprite<true>(const uint8_t, const uint8_t, const std::span<const uint8_t>, const bool);
+
+void Framebuffer::scroll_down(const uint8_t amount) {
+    const size_t height = this->get_height();
+    const auto moved = std::min<size_t>(amount, height);
+    for(auto& word : this->rows) {
+        std::memmove(word + moved, word, (height - moved) * sizeof word[0]);
+        std::memset(word, 0, moved * sizeof word[0]);
+    }
+    this->dirty = true;
+}
+
+void Framebuffer::scroll_right() {
+    // Low resolution rows are a single word, whose pixels must not spill into the unused second one
+    if(!this->hires) {
+        for(size_t y = 0; y < LORES_HEIGHT; y++) this->rows[0][y] >>= 4;
+    } else {
+        for(size_t y = 0; y < HEIGHT; y++) {
+            this->rows[1][y] = (this->rows[1][y] >> 4) | (this->rows[0][y] << 60);
+            this->rows[0][y] >>= 4;
+        }
+    }
+    this->dirty = true;
 }
 
-void GPU::clear_framebuffer() {
-    for(int8_t y = 0; y < HEIGHT; y++) {
-        for(int8_t x = 0; x < WIDTH; x++) {
-            this->framebuffer.setPixel(x, y, OFF_COLOR);
+void Framebuffer::scroll_left() {
+    if(!this->hires) {
+        for(size_t y = 0; y < LORES_HEIGHT; y++) this->rows[0][y] <<= 4;
+    } else {
+        for(size_t y = 0; y < HEIGHT; y++) {
+            this->rows[0][y] = (this->rows[0][y] << 4) | (this->rows[1][y] >> 60);
+            this->rows[1][y] <<= 4;
         }
     }
+    this->dirty = true;
+}
+
+bool Framebuffer::get_pixel(const uint8_t x, const uint8_t y) const {
+    return (this->rows[x / 64][y] >> (63 - x % 64)) & 0x01;
+}
+
+uint64_t Framebuffer::get_word(const uint8_t word, const uint8_t y) const {
+    return this->rows[word][y];
+}
+
+bool Framebuffer::is_dirty() const {
+    return this->dirty;
 }
 
-void GPU::draw() {
-    this->graphics.update(this->framebuffer);
-    this->active_screen.draw(this->drawable_graphics);
-    this->active_screen.display();
+void Framebuffer::set_clean() {
+    this->dirty = false;
 }
 
-#undef WIDTH
-#undef HEIGHT
-#undef SCALE_FACTOR
-#undef ON_COLOR
-#undef OFF_COLOR
+bool Framebuffer::is_valid(const uint8_t* bytes) {
+    return bytes[offsetof(Framebuffer, hires)] <= 1 && bytes[offsetof(Framebuffer, dirty)] <= 1;
+}
+
+void Framebuffer::set_dirty() {
+    this->dirty = true;
+}
+
+uint64_t Framebuffer::hash() const {
+    // Only the words in use, so low resolution screens hash as they did before high resolution existed
+    const size_t words = this->hires ? WORDS : 1;
+    uint64_t result = FNV_OFFSET_BASIS;
+    for(uint8_t y = 0; y < this->get_height(); y++) {
+        for(size_t word = 0; word < words; word++) {
+            result ^= this->rows[word][y];
+            result *= FNV_PRIME;
+        }
+    }
+    return result;
+}
 
 #define PROGRAMS_OFFSET 0x200
+#define QUIRKS(name) profiles[static_cast<size_t>(Profile::name)]
 #define OPCODE_SPAN 2
+#define ADDRESS_MASK 0x0fff
 
-#define KEY_UP 1
-#define KEY_DOWN 0
 #define BYTES_PER_FONT 5
+#define WIDE_SPRITE_BYTES 32
+// A 500 Hz square wave at the default pitch, for ROMs that never load a pattern
+#define DEFAULT_PATTERN 0xf0
+#define DEFAULT_PITCH 64
 const uint8_t fontset[80] =
 {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -94,370 +194,785 @@ const uint8_t fontset[80] =
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-#ifdef DEBUG
-#define debug_log(...) std::printf(__VA_ARGS__)
-#else
-#define debug_log(...)
-#endif
+void Random::seed(const uint64_t seed) {
+    // One splitmix64 step, so that close seeds still start far apart
+    uint64_t mixed = seed + 0x9e3779b97f4a7c15;
+    mixed = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9;
+    mixed = (mixed ^ (mixed >> 27)) * 0x94d049bb133111eb;
+    mixed ^= mixed >> 31;
 
-void CPU::init() {
-    std::memset(this->ram, 0, sizeof this->ram);
-    std::memcpy(this->ram, fontset, sizeof fontset);
+    // Xorshift never leaves an all-zero state
+    this->value = (mixed != 0) ? mixed : 1;
+}
 
-    std::memset(this->v, 0, 0xf);
-    this->pc = PROGRAMS_OFFSET;
-    this->i = 0;
+uint8_t Random::next_byte() {
+    this->value ^= this->value >> 12;
+    this->value ^= this->value << 25;
+    this->value ^= this->value >> 27;
+    // The upper bits of the multiplied state are the best distributed ones
+    return (this->value * 0x2545f4914f6cdd1d) >> 56;
+}
 
-    this->dt = 0;
-    this->st = 0;
+const char* describe(const Fault fault) {
+    switch(fault) {
+        case Fault::NONE: return "none";
+        case Fault::UNKNOWN_OPCODE: return "unknown opcode";
+        case Fault::STACK_UNDERFLOW: return "could not return from subroutine, stack was empty";
+        case Fault::STACK_OVERFLOW: return "stack overflow";
+        case Fault::OUT_OF_BOUNDS: return "memory access past the end of ram";
+    }
+    return "unknown fault";
+}
 
-    this->blocked = false;
-    this->keys = {
-        {0x0, KEY_DOWN}, {0x1, KEY_DOWN}, {0x2, KEY_DOWN}, {0x3, KEY_DOWN},
-        {0x4, KEY_DOWN}, {0x5, KEY_DOWN}, {0x6, KEY_DOWN}, {0x7, KEY_DOWN},
-        {0x8, KEY_DOWN}, {0x9, KEY_DOWN}, {0xa, KEY_DOWN}, {0xb, KEY_DOWN},
-        {0xc, KEY_DOWN}, {0xd, KEY_DOWN}, {0xe, KEY_DOWN}, {0xf, KEY_DOWN},
-    };
+// Indexed by Profile
+const char* const profile_names[] = {"reference", "chip8", "schip", "xochip"};
 
-    std::srand(std::time(NULL));
+const char* describe(const Profile profile) {
+    static_assert(std::size(profile_names) == static_cast<size_t>(Profile::COUNT) && std::size(profiles) == std::size(profile_names));
+    return (profile < Profile::COUNT) ? profile_names[static_cast<size_t>(profile)] : "unknown profile";
 }
 
-void CPU::dump_into_memory(const std::string file_path) {
-    const auto extension = file_path.substr(file_path.find_last_of('.'));
-    if(extension != ".ch8") {
-        throw std::runtime_error(std::format("file extension not supported: {}\n", extension));
+bool parse_profile(const std::string& name, Profile& profile) {
+    for(size_t index = 0; index < std::size(profile_names); index++) {
+        if(name != profile_names[index]) continue;
+        profile = static_cast<Profile>(index);
+        return true;
     }
+    return false;
+}
+
+void CPU::init(const uint64_t seed) {
+    static_assert(std::is_trivially_copyable_v<State>);
+
+    std::memset(&this->state, 0, sizeof this->state);
+    std::memcpy(this->state.ram, fontset, sizeof fontset);
+    std::memset(this->decoded, 0, sizeof this->decoded);
+
+    this->state.framebuffer.clear();
+    this->state.pc = PROGRAMS_OFFSET;
+    std::memset(this->state.pattern, DEFAULT_PATTERN, sizeof this->state.pattern);
+    this->state.pitch = DEFAULT_PITCH;
+
+    this->state.random.seed(seed);
+    this->fault = {Fault::NONE, 0, 0};
+    this->profile = Profile::REFERENCE;
+}
 
-    std::ifstream file(file_path, std::ios::binary);
-    if(!file.is_open()) {
-        throw std::runtime_error(std::format("could not open rom: {}\n", file_path));
+void CPU::dump_into_memory(const std::string file_path) {
+    const RomImage rom(file_path);
+    this->load(rom.bytes());
+}
+
+void CPU::load(const std::span<const uint8_t> rom) {
+    const auto capacity = sizeof this->state.ram - PROGRAMS_OFFSET;
+    if(rom.size() > capacity) {
+        throw std::runtime_error(std::format("rom too large: {} bytes, at most {} fit\n", rom.size(), capacity));
     }
 
-    size_t index = 0;
-    char byte;
-    while(file.get(byte)) {
-        this->ram[this->pc + index] = static_cast<uint8_t>(byte);
-        index++;
+    std::memcpy(this->state.ram + PROGRAMS_OFFSET, rom.data(), rom.size());
+    this->invalidate(PROGRAMS_OFFSET, rom.size());
+}
+
+Framebuffer& CPU::get_framebuffer() {
+    return this->state.framebuffer;
+}
+
+const Framebuffer& CPU::get_framebuffer() const {
+    return this->state.framebuffer;
+}
+
+uint16_t CPU::get_keys() const {
+    return this->state.keys;
+}
+
+uint8_t CPU::get_sound_timer() const {
+    return this->state.st;
+}
+
+std::span<const uint8_t, 16> CPU::get_pattern() const {
+    return std::span<const uint8_t, 16>(this->state.pattern);
+}
+
+uint8_t CPU::get_pitch() const {
+    return this->state.pitch;
+}
+
+uint64_t CPU::hash() const {
+    // Starts from the framebuffer's own hash, which leaves its dirty flag out
+    uint64_t result = this->state.framebuffer.hash();
+    const auto bytes = reinterpret_cast<const uint8_t*>(&this->state);
+    // Stops before the audio, so it does not tell apart runs whose execution was the same
+    for(size_t index = offsetof(State, ram); index < offsetof(State, pattern); index++) {
+        result ^= bytes[index];
+        result *= FNV_PRIME;
     }
+    return result;
+}
+
+const FaultStatus& CPU::get_fault() const {
+    return this->fault;
+}
+
+void CPU::set_profile(const Profile profile) {
+    this->profile = profile;
+}
+
+Profile CPU::get_profile() const {
+    return this->profile;
+}
+
+bool CPU::is_waiting_for_key() const {
+    return this->state.blocked && this->state.dt == 0 && this->state.st == 0;
+}
+
+void CPU::snapshot(State& destination) const {
+    std::memcpy(&destination, &this->state, sizeof this->state);
+}
+
+void CPU::restore(const State& source) {
+    std::memcpy(&this->state, &source, sizeof this->state);
+    // Cheaper than comparing the old and new ram to invalidate only what changed
+    std::memset(this->decoded, 0, sizeof this->decoded);
+    this->state.framebuffer.set_dirty();
+    this->fault = {Fault::NONE, 0, 0};
+}
+
+void CPU::set_key(const uint8_t key, const bool pressed) {
+    const uint16_t mask = 1 << (key & 0xf);
+    this->state.keys = pressed ? (this->state.keys | mask) : (this->state.keys & ~mask);
+}
+
+bool CPU::in_bounds(const size_t length) const {
+    return static_cast<size_t>(this->state.i) + length <= sizeof this->state.ram;
+}
 
-    file.close();
+bool CPU::is_pressed(const uint8_t key) const {
+    return (key <= 0xf) && ((this->state.keys >> key) & 0x01);
 }
 
 uint16_t CPU::fetch_opcode() {
-    const auto high_byte = this->ram[this->pc];
-    const auto low_byte = this->ram[this->pc + 1];
+    const auto high_byte = this->state.ram[this->state.pc & ADDRESS_MASK];
+    const auto low_byte = this->state.ram[(this->state.pc + 1) & ADDRESS_MASK];
 
-    this->pc += OPCODE_SPAN;
     return (high_byte << 0x8) + low_byte;
 }
 
-void CPU::execute(const uint16_t opcode) {
+Instruction CPU::decode(const uint16_t opcode) {
+    Instruction instruction;
+    instruction.x = (opcode & 0x0f00) >> 8;
+    instruction.y = (opcode & 0x00f0) >> 4;
+    instruction.n = opcode & 0x000f;
+    instruction.nn = opcode & 0x00ff;
+    instruction.nnn = opcode & 0x0fff;
+
     const uint8_t kind = (opcode & 0xf000) >> 12;
-    debug_log("opcode: %x\n", opcode);
     switch(kind) {
         case 0x0:
         {
             switch(opcode) {
-                case 0x00E0: // CLS
-                    this->gpu.clear_framebuffer();
-                    debug_log("CLS\n");
-                break;
-
-                case 0x00EE: // RET
-                    if(this->stack.empty()) throw std::runtime_error("could not return from subroutine, stack was empty\n");
-                    this->pc = this->stack.top();
-                    this->stack.pop();
-                    debug_log("RET %x\n", this->pc);
-                break;
-
-                default: break; // SYS address
+                case 0x00E0: instruction.operation = Operation::CLS; break;
+                case 0x00EE: instruction.operation = Operation::RET; break;
+                case 0x00FB: instruction.operation = Operation::SCR; break;
+                case 0x00FC: instruction.operation = Operation::SCL; break;
+                case 0x00FE: instruction.operation = Operation::LOW; break;
+                case 0x00FF: instruction.operation = Operation::HIGH; break;
+                default: instruction.operation = ((opcode & 0xfff0) == 0x00C0) ? Operation::SCD : Operation::SYS; break;
             }
         } break;
 
-        case 0x1: { // JP address
-            const uint16_t address = opcode & 0x0fff;
-            this->pc = address;
-            debug_log("JP %x\n", address);
-        } break;
+        case 0x1: instruction.operation = Operation::JP; break;
+        case 0x2: instruction.operation = Operation::CALL; break;
+        case 0x3: instruction.operation = Operation::SE_BYTE; break;
+        case 0x4: instruction.operation = Operation::SNE_BYTE; break;
+        case 0x5: instruction.operation = Operation::SE_REGISTER; break;
+        case 0x6: instruction.operation = Operation::LD_BYTE; break;
+        case 0x7: instruction.operation = Operation::ADD_BYTE; break;
 
-        case 0x2: { // CALL address
-            if(this->stack.size() > 0xf) throw std::runtime_error("stack overflow\n");
-            const uint16_t address = opcode & 0x0fff;
-            this->stack.push(this->pc);
-            this->pc = address;
-            debug_log("CALL %x\n", address);
+        case 0x8:
+        {
+            switch(instruction.n) {
+                case 0x0: instruction.operation = Operation::LD_REGISTER; break;
+                case 0x1: instruction.operation = Operation::OR; break;
+                case 0x2: instruction.operation = Operation::AND; break;
+                case 0x3: instruction.operation = Operation::XOR; break;
+                case 0x4: instruction.operation = Operation::ADD_REGISTER; break;
+                case 0x5: instruction.operation = Operation::SUB; break;
+                case 0x6: instruction.operation = Operation::SHR; break;
+                case 0x7: instruction.operation = Operation::SUBN; break;
+                case 0xE: instruction.operation = Operation::SHL; break;
+                default: instruction.operation = Operation::UNKNOWN; break;
+            }
         } break;
 
-        case 0x3: { // SE Vx, value
-            const uint8_t target = (opcode & 0x0f00) >> 8;
-            const uint8_t value = opcode & 0x00ff;
-            if(this->v[target] == value) this->pc += OPCODE_SPAN;
-            debug_log("SE V%x, %x\n", target, value);
-        } break;
+        case 0x9: instruction.operation = Operation::SNE_REGISTER; break;
+        case 0xA: instruction.operation = Operation::LD_I; break;
+        case 0xB: instruction.operation = Operation::JP_V0; break;
+        case 0xC: instruction.operation = Operation::RND; break;
+        case 0xD: instruction.operation = Operation::DRW; break;
 
-        case 0x4: { // SNE Vx, value
-            const uint8_t target = (opcode & 0x0f00) >> 8;
-            const uint8_t value = opcode & 0x00ff;
-            if(this->v[target] != value) this->pc += OPCODE_SPAN;
-            debug_log("SNE V%x, %x\n", target, value);
+        case 0xE:
+        {
+            switch(instruction.nn) {
+                case 0x9E: instruction.operation = Operation::SKP; break;
+                case 0xA1: instruction.operation = Operation::SKNP; break;
+                default: instruction.operation = Operation::UNKNOWN; break;
+            }
         } break;
 
-        case 0x5: { // SE Vx, Vy
-            const uint8_t target = (opcode & 0x0f00) >> 8;
-            const uint8_t source = (opcode & 0x00f0) >> 4;
-            if(this->v[target] == this->v[source]) this->pc += OPCODE_SPAN;
-            debug_log("SE V%x, V%x\n", target, source);
+        case 0xF:
+        {
+            switch(instruction.nn) {
+                case 0x02: instruction.operation = (instruction.x == 0) ? Operation::LD_AUDIO : Operation::UNKNOWN; break;
+                case 0x07: instruction.operation = Operation::LD_VX_DT; break;
+                case 0x0A: instruction.operation = Operation::LD_VX_K; break;
+                case 0x15: instruction.operation = Operation::LD_DT_VX; break;
+                case 0x18: instruction.operation = Operation::LD_ST_VX; break;
+                case 0x1E: instruction.operation = Operation::ADD_I; break;
+                case 0x29: instruction.operation = Operation::LD_F; break;
+                case 0x33: instruction.operation = Operation::LD_B; break;
+                case 0x3A: instruction.operation = Operation::LD_PITCH; break;
+                case 0x55: instruction.operation = Operation::LD_MEMORY_VX; break;
+                case 0x65: instruction.operation = Operation::LD_VX_MEMORY; break;
+                default: instruction.operation = Operation::UNKNOWN; break;
+            }
         } break;
 
-        case 0x6: { // LD Vx, value
-            const uint8_t target = (opcode & 0x0f00) >> 8;
-            const uint8_t value = opcode & 0x00ff;
-            this->v[target] = value;
-            debug_log("LD V%x, %x\n", target, value);
-        } break;
+        default: instruction.operation = Operation::UNKNOWN; break;
+    }
 
-        case 0x7: { // ADD Vx, value
-            const uint8_t target = (opcode & 0x0f00) >> 8;
-            const uint8_t value = opcode & 0x00ff;
-            this->v[target] += value;
-            debug_log("ADD V%x, %x\n", target, value);
-        } break;
+    return instruction;
+}
 
-        case 0x8:
-        {
-            const uint8_t nibble = opcode & 0x000f;
-            switch(nibble) {
-                case 0x0: { // LD Vx, Vy
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    const uint8_t source = (opcode & 0x00f0) >> 4;
-                    this->v[target] = this->v[source];
-                    debug_log("LD V%x, V%x\n", target, source);
-                } break;
-
-                case 0x1: { // OR Vx, Vy
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    const uint8_t source = (opcode & 0x00f0) >> 4;
-                    this->v[target] |= this->v[source];
-                    debug_log("OR V%x, V%x\n", target, source);
-                } break;
-
-                case 0x2: { // AND Vx, Vy
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    const uint8_t source = (opcode & 0x00f0) >> 4;
-                    this->v[target] &= this->v[source];
-                    debug_log("AND V%x, V%x\n", target, source);
-                } break;
-
-                case 0x3: { // XOR Vx, Vy
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    const uint8_t source = (opcode & 0x00f0) >> 4;
-                    this->v[target] ^= this->v[source];
-                    debug_log("XOR V%x, V%x\n", target, source);
-                } break;
-
-                case 0x4: { // ADD Vx, Vy
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    const uint8_t source = (opcode & 0x00f0) >> 4;
-                    const auto carry = ((this->v[target] + this->v[source]) >= 0xff);
-                    this->v[target] += this->v[source];
-                    this->v[0xf] = carry;
-                    debug_log("ADD V%x, V%x\n", target, source);
-                } break;
-
-                case 0x5: { // SUB Vx, Vy
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    const uint8_t source = (opcode & 0x00f0) >> 4;
-                    const auto not_borrow = (this->v[target] >= this->v[source]);
-                    this->v[target] = this->v[target] - this->v[source];
-                    this->v[0xf] = not_borrow;
-                    debug_log("SUB V%x, V%x\n", target, source);
-                } break;
-
-                case 0x6: { // SHR Vx, Vy
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    const auto least_significant_bit = this->v[target] & 0x001;
-                    this->v[target] >>= 1;
-                    this->v[0xf] = least_significant_bit;
-                    debug_log("SHR V%x\n", target);
-                } break;
-
-                case 0x7: { // SUBN Vx, Vy
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    const uint8_t source = (opcode & 0x00f0) >> 4;
-                    this->v[target] = this->v[source] - this->v[target];
-                    this->v[0xf] = (this->v[source] > this->v[target]);
-                    debug_log("SUBN V%x, V%x\n", target, source);
-                } break;
-
-                case 0xE: { // SHL Vx, Vy
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    const auto most_significant_bit = this->v[target] & 0x80;
-                    this->v[target] <<= 1;
-                    this->v[0xf] = (most_significant_bit > 0) ? 1 : 0;
-                    debug_log("SHL V%x\n", target);
-                } break;
-
-                default: throw std::runtime_error("unknown opcode\n");
-            }
-        } break;
+void CPU::halt(const Fault fault) {
+    this->state.pc -= OPCODE_SPAN;
+    this->fault = {fault, this->state.pc, this->fetch_opcode()};
+}
 
-        case 0x9: { // SNE Vx, Vy
-            const uint8_t target = (opcode & 0x0f00) >> 8;
-            const uint8_t source = (opcode & 0x00f0) >> 4;
-            if(this->v[target] != this->v[source]) this->pc += OPCODE_SPAN;
-            debug_log("SNE V%x, V%x\n", target, source);
-        } break;
+void CPU::invalidate(const uint16_t address, const size_t length) {
+    // An entry at address - 1 also decoded the byte at address
+    const size_t begin = (address > 0) ? address - 1 : 0;
+    const size_t end = std::min(address + length, sizeof this->state.ram);
+    if(begin >= end) return;
 
-        case 0xA: { // LD I, address
-            const uint16_t address = opcode & 0x0fff;
-            this->i = address;
-            debug_log("LD I, %x\n", address);
-        } break;
+    std::memset(&this->decoded[begin], 0, (end - begin) * sizeof(Instruction));
+}
 
-        case 0xB: { // JP V0, address
-            const uint16_t address = opcode & 0x0fff;
-            this->pc = address + this->v[0];
-            debug_log("JP V0, %x\n", address);
-        } break;
+// Indexed by Operation
+template<Quirks Q>
+const CPU::Handler CPU::handlers[] = {
+    &CPU::op_unknown,         // UNDECODED, never dispatched
+    &CPU::op_sys,             // SYS
+    &CPU::op_cls,             // CLS
+    &CPU::op_ret,             // RET
+    &CPU::op_scd<Q>,          // SCD
+    &CPU::op_scr<Q>,          // SCR
+    &CPU::op_scl<Q>,          // SCL
+    &CPU::op_low<Q>,          // LOW
+    &CPU::op_high<Q>,         // HIGH
+    &CPU::op_jp,              // JP
+    &CPU::op_call,            // CALL
+    &CPU::op_se_byte,         // SE_BYTE
+    &CPU::op_sne_byte,        // SNE_BYTE
+    &CPU::op_se_register,     // SE_REGISTER
+    &CPU::op_ld_byte,         // LD_BYTE
+    &CPU::op_add_byte,        // ADD_BYTE
+    &CPU::op_ld_register,     // LD_REGISTER
+    &CPU::op_or,              // OR
+    &CPU::op_and,             // AND
+    &CPU::op_xor,             // XOR
+    &CPU::op_add_register,    // ADD_REGISTER
+    &CPU::op_sub,             // SUB
+    &CPU::op_shr<Q>,          // SHR
+    &CPU::op_subn,            // SUBN
+    &CPU::op_shl<Q>,          // SHL
+    &CPU::op_sne_register,    // SNE_REGISTER
+    &CPU::op_ld_i,            // LD_I
+    &CPU::op_jp_v0<Q>,        // JP_V0
+    &CPU::op_rnd,             // RND
+    &CPU::op_drw<Q>,          // DRW
+    &CPU::op_skp,             // SKP
+    &CPU::op_sknp,            // SKNP
+    &CPU::op_ld_vx_dt,        // LD_VX_DT
+    &CPU::op_ld_vx_k,         // LD_VX_K
+    &CPU::op_ld_dt_vx,        // LD_DT_VX
+    &CPU::op_ld_st_vx,        // LD_ST_VX
+    &CPU::op_add_i,           // ADD_I
+    &CPU::op_ld_f,            // LD_F
+    &CPU::op_ld_b,            // LD_B
+    &CPU::op_ld_memory_vx<Q>, // LD_MEMORY_VX
+    &CPU::op_ld_vx_memory<Q>, // LD_VX_MEMORY
+    &CPU::op_ld_audio<Q>,     // LD_AUDIO
+    &CPU::op_ld_pitch<Q>,     // LD_PITCH
+    &CPU::op_unknown,         // UNKNOWN
+};
 
-        case 0xC: { // RND Vx, byte
-            const uint8_t target = (opcode & 0x0f00) >> 8;
-            const uint8_t value = opcode & 0x00ff;
-            this->v[target] = (std::rand() % 256) & value;
-            debug_log("RND V%x, %x\n", target, value);
-        } break;
+void CPU::op_sys(const Instruction&) {}
 
-        case 0xD: { // DRW Vx, Vy, length
-            const uint8_t x = (opcode & 0x0f00) >> 8;
-            const uint8_t y = (opcode & 0x00f0) >> 4;
-            const uint8_t length = opcode & 0x000f;
+void CPU::op_cls(const Instruction&) {
+    this->state.framebuffer.clear();
+}
 
-            std::vector<uint8_t> sprite;
-            for(int8_t byte = 0; byte < length; byte++) {
-                sprite.push_back(this->ram[this->i + byte]);
-            }
+void CPU::op_ret(const Instruction&) {
+    if(this->state.sp == 0) return this->halt(Fault::STACK_UNDERFLOW);
+    this->state.pc = this->state.stack[--this->state.sp];
+}
 
-            this->v[0xf] = this->gpu.copy_to_framebuffer(this->v[x], this->v[y], sprite);
-            debug_log("DRW V%x, V%x, %x\n", x, y, length);
-        } break;
+template<Quirks Q>
+void CPU::op_scd(const Instruction& instruction) {
+    if constexpr(Q.extended) this->state.framebuffer.scroll_down(instruction.n);
+}
 
-        case 0xE:
-        {
-            const uint8_t source = (opcode & 0x0f00) >> 8;
-            auto& key_state = this->keys[this->v[source]];
-
-            const uint8_t low_byte = opcode & 0x00ff;
-            switch(low_byte) {
-                case 0x9E: { // SKP Vx
-                    if(key_state == KEY_UP) this->pc += OPCODE_SPAN;
-                    debug_log("SKP V%x\n", source);
-                } break;
-
-                case 0xA1: { // SKNP Vx
-                    if(key_state == KEY_DOWN) this->pc += OPCODE_SPAN;
-                    debug_log("SKNP V%x\n", source);
-                } break;
-
-                default: throw std::runtime_error("unknown opcode\n");
-            }
-        } break;
+template<Quirks Q>
+void CPU::op_scr(const Instruction&) {
+    if constexpr(Q.extended) this->state.framebuffer.scroll_right();
+}
 
-        case 0xF:
-        {
-            const uint8_t low_byte = opcode & 0x00ff;
-            switch(low_byte) {
-                case 0x07: { // LD Vx, DT
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    this->v[target] = this->dt;
-                    debug_log("LD V%x, DT\n", target);
-                } break;
-
-                case 0x0A: { // LD Vx, K
-                    const uint8_t target = (opcode & 0x0f00) >> 8;
-                    this->blocked = true;
-                    for(const auto& [code, state] : this->keys) {
-                        if(state == KEY_DOWN) continue;
-                        this->v[target] = code;
-                        this->blocked = false;
-                    }
-                    debug_log("LD V%x, K\n", target);
-                } break;
-
-                case 0x15: { // LD DT, Vx
-                    const uint8_t source = (opcode & 0x0f00) >> 8;
-                    this->dt = this->v[source];
-                    debug_log("LD DT, V%x\n", source);
-                } break;
-
-                case 0x18: { // LD ST, Vx
-                    const uint8_t source = (opcode & 0x0f00) >> 8;
-                    this->st = this->v[source];
-                    debug_log("LD ST, V%x\n", source);
-                } break;
-
-                case 0x1E: { // ADD I, Vx
-                    const uint8_t source = (opcode & 0x0f00) >> 8;
-                    this->i += this->v[source];
-                    debug_log("ADD I, V%x\n", source);
-                } break;
-
-                case 0x29: { // LD F, VX
-                    const uint8_t source = (opcode & 0x0f00) >> 8;
-                    this->i = this->v[source] * BYTES_PER_FONT;
-                    debug_log("LD F, V%x\n", source);
-                } break;
-
-                case 0x33: { // LD B, Vx
-                    const uint8_t source = (opcode & 0x0f00) >> 8;
-                    const uint8_t hundreds = this->v[source] / 100;
-                    const uint8_t tens = (this->v[source] - hundreds * 100) / 10;
-                    const uint8_t ones = this->v[source] - hundreds * 100 - tens * 10;
-                    this->ram[this->i] = hundreds;
-                    this->ram[this->i + 1] = tens;
-                    this->ram[this->i + 2] = ones;
-                    debug_log("LD B, V%x\n", source);
-                } break;
-
-                case 0x55: { // LD [I], VX
-                    const uint8_t end = (opcode & 0x0f00) >> 8;
-                    for(size_t index = 0; index <= end; index++) {
-                        this->ram[this->i + index] = this->v[index];
-                    }
-                    debug_log("LD I [V0...V%x]\n", end);
-                } break;
-
-                case 0x65: { // LD Vx, [I]
-                    const uint8_t end = (opcode & 0x0f00) >> 8;
-                    for(size_t index = 0; index <= end; index++) {
-                        this->v[index] = this->ram[this->i + index];
-                    }
-                    debug_log("LD [V0...V%x] I\n", end);
-                } break;
-
-                default: throw std::runtime_error("unknown opcode\n");
-            }
-        } break;
+template<Quirks Q>
+void CPU::op_scl(const Instruction&) {
+    if constexpr(Q.extended) this->state.framebuffer.scroll_left();
+}
+
+template<Quirks Q>
+void CPU::op_low(const Instruction&) {
+    if constexpr(Q.extended) this->state.framebuffer.set_hires(false);
+}
+
+template<Quirks Q>
+void CPU::op_high(const Instruction&) {
+    if constexpr(Q.extended) this->state.framebuffer.set_hires(true);
+}
+
+void CPU::op_jp(const Instruction& instruction) {
+    this->state.pc = instruction.nnn;
+}
+
+void CPU::op_call(const Instruction& instruction) {
+    if(this->state.sp > 0xf) return this->halt(Fault::STACK_OVERFLOW);
+    this->state.stack[this->state.sp++] = this->state.pc;
+    this->state.pc = instruction.nnn;
+}
+
+void CPU::op_se_byte(const Instruction& instruction) {
+    if(this->state.v[instruction.x] == instruction.nn) this->state.pc += OPCODE_SPAN;
+}
+
+void CPU::op_sne_byte(const Instruction& instruction) {
+    if(this->state.v[instruction.x] != instruction.nn) this->state.pc += OPCODE_SPAN;
+}
+
+void CPU::op_se_register(const Instruction& instruction) {
+    if(this->state.v[instruction.x] == this->state.v[instruction.y]) this->state.pc += OPCODE_SPAN;
+}
+
+void CPU::op_ld_byte(const Instruction& instruction) {
+    this->state.v[instruction.x] = instruction.nn;
+}
+
+void CPU::op_add_byte(const Instruction& instruction) {
+    this->state.v[instruction.x] += instruction.nn;
+}
+
+void CPU::op_ld_register(const Instruction& instruction) {
+    this->state.v[instruction.x] = this->state.v[instruction.y];
+}
+
+void CPU::op_or(const Instruction& instruction) {
+    this->state.v[instruction.x] |= this->state.v[instruction.y];
+}
+
+void CPU::op_and(const Instruction& instruction) {
+    this->state.v[instruction.x] &= this->state.v[instruction.y];
+}
+
+void CPU::op_xor(const Instruction& instruction) {
+    this->state.v[instruction.x] ^= this->state.v[instruction.y];
+}
+
+void CPU::op_add_register(const Instruction& instruction) {
+    const auto carry = ((this->state.v[instruction.x] + this->state.v[instruction.y]) >= 0xff);
+    this->state.v[instruction.x] += this->state.v[instruction.y];
+    this->state.v[0xf] = carry;
+}
+
+void CPU::op_sub(const Instruction& instruction) {
+    const auto not_borrow = (this->state.v[instruction.x] >= this->state.v[instruction.y]);
+    this->state.v[instruction.x] = this->state.v[instruction.x] - this->state.v[instruction.y];
+    this->state.v[0xf] = not_borrow;
+}
+
+template<Quirks Q>
+void CPU::op_shr(const Instruction& instruction) {
+    const auto source = this->state.v[Q.shift_vy ? instruction.y : instruction.x];
+    const auto least_significant_bit = source & 0x001;
+    this->state.v[instruction.x] = source >> 1;
+    this->state.v[0xf] = least_significant_bit;
+}
+
+void CPU::op_subn(const Instruction& instruction) {
+    this->state.v[instruction.x] = this->state.v[instruction.y] - this->state.v[instruction.x];
+    this->state.v[0xf] = (this->state.v[instruction.y] > this->state.v[instruction.x]);
+}
+
+template<Quirks Q>
+void CPU::op_shl(const Instruction& instruction) {
+    const auto source = this->state.v[Q.shift_vy ? instruction.y : instruction.x];
+    const auto most_significant_bit = source & 0x80;
+    this->state.v[instruction.x] = source << 1;
+    this->state.v[0xf] = (most_significant_bit > 0) ? 1 : 0;
+}
+
+void CPU::op_sne_register(const Instruction& instruction) {
+    if(this->state.v[instruction.x] != this->state.v[instruction.y]) this->state.pc += OPCODE_SPAN;
+}
+
+void CPU::op_ld_i(const Instruction& instruction) {
+    this->state.i = instruction.nnn;
+}
+
+template<Quirks Q>
+void CPU::op_jp_v0(const Instruction& instruction) {
+    this->state.pc = instruction.nnn + this->state.v[Q.jump_vx ? instruction.x : 0];
+}
+
+void CPU::op_rnd(const Instruction& instruction) {
+    this->state.v[instruction.x] = this->state.random.next_byte() & instruction.nn;
+}
+
+template<Quirks Q>
+void CPU::op_drw(const Instruction& instruction) {
+    // DXY0 draws 16 rows of 16 pixels
+    const auto wide = Q.extended && instruction.n == 0;
+    const size_t length = wide ? WIDE_SPRITE_BYTES : instruction.n;
+    if(!this->in_bounds(length)) return this->halt(Fault::OUT_OF_BOUNDS);
+    const auto sprite = std::span<const uint8_t>(this->state.ram + this->state.i, length);
+
+    this->state.v[0xf] = this->state.framebuffer.draw_sprite<Q.clip>(this->state.v[instruction.x], this->state.v[instruction.y], sprite, wide);
+}
 
-        default: throw std::runtime_error("unknown opcode\n");
+void CPU::op_skp(const Instruction& instruction) {
+    if(this->is_pressed(this->state.v[instruction.x])) this->state.pc += OPCODE_SPAN;
+}
+
+void CPU::op_sknp(const Instruction& instruction) {
+    if(!this->is_pressed(this->state.v[instruction.x])) this->state.pc += OPCODE_SPAN;
+}
+
+void CPU::op_ld_vx_dt(const Instruction& instruction) {
+    this->state.v[instruction.x] = this->state.dt;
+}
+
+void CPU::op_ld_vx_k(const Instruction& instruction) {
+    // The highest pressed key wins
+    this->state.blocked = (this->state.keys == 0);
+    if(!this->state.blocked) this->state.v[instruction.x] = std::bit_width(this->state.keys) - 1;
+}
+
+void CPU::op_ld_dt_vx(const Instruction& instruction) {
+    this->state.dt = this->state.v[instruction.x];
+}
+
+void CPU::op_ld_st_vx(const Instruction& instruction) {
+    this->state.st = this->state.v[instruction.x];
+}
+
+void CPU::op_add_i(const Instruction& instruction) {
+    this->state.i += this->state.v[instruction.x];
+}
+
+void CPU::op_ld_f(const Instruction& instruction) {
+    this->state.i = this->state.v[instruction.x] * BYTES_PER_FONT;
+}
+
+void CPU::op_ld_b(const Instruction& instruction) {
+    if(!this->in_bounds(3)) return this->halt(Fault::OUT_OF_BOUNDS);
+    const auto value = this->state.v[instruction.x];
+    const uint8_t hundreds = value / 100;
+    const uint8_t tens = (value - hundreds * 100) / 10;
+    const uint8_t ones = value - hundreds * 100 - tens * 10;
+    this->state.ram[this->state.i] = hundreds;
+    this->state.ram[this->state.i + 1] = tens;
+    this->state.ram[this->state.i + 2] = ones;
+    this->invalidate(this->state.i, 3);
+}
+
+template<Quirks Q>
+void CPU::op_ld_memory_vx(const Instruction& instruction) {
+    if(!this->in_bounds(instruction.x + 1)) return this->halt(Fault::OUT_OF_BOUNDS);
+    for(size_t index = 0; index <= instruction.x; index++) {
+        this->state.ram[this->state.i + index] = this->state.v[index];
+    }
+    this->invalidate(this->state.i, instruction.x + 1);
+    if constexpr(Q.increment_i) this->state.i += instruction.x + 1;
+}
+
+template<Quirks Q>
+void CPU::op_ld_vx_memory(const Instruction& instruction) {
+    if(!this->in_bounds(instruction.x + 1)) return this->halt(Fault::OUT_OF_BOUNDS);
+    for(size_t index = 0; index <= instruction.x; index++) {
+        this->state.v[index] = this->state.ram[this->state.i + index];
+    }
+    if constexpr(Q.increment_i) this->state.i += instruction.x + 1;
+}
+
+template<Quirks Q>
+void CPU::op_ld_audio(const Instruction& instruction) {
+    if constexpr(!Q.audio) return this->op_unknown(instruction);
+    if(!this->in_bounds(sizeof this->state.pattern)) return this->halt(Fault::OUT_OF_BOUNDS);
+    std::memcpy(this->state.pattern, &this->state.ram[this->state.i], sizeof this->state.pattern);
+}
+
+template<Quirks Q>
+void CPU::op_ld_pitch(const Instruction& instruction) {
+    if constexpr(!Q.audio) return this->op_unknown(instruction);
+    this->state.pitch = this->state.v[instruction.x];
+}
+
+void CPU::op_unknown(const Instruction&) {
+    this->halt(Fault::UNKNOWN_OPCODE);
+}
+
+Instruction CPU::fetch_instruction() {
+    auto& entry = this->decoded[this->state.pc & ADDRESS_MASK];
+    if(entry.operation == Operation::UNDECODED) entry = this->decode(this->fetch_opcode());
+
+    this->state.pc += OPCODE_SPAN;
+    return entry; // Copied, as a handler writing over code invalidates the entry in place
+}
+
+uint64_t CPU::idle_cycles(const uint64_t cycles) const {
+    // Keys only change between calls to this->run, so FX0A stays blocked for all of them
+    if(this->state.blocked) return cycles;
+
+    const auto pc = this->state.pc;
+    if(this->state.dt == 0 || pc < OPCODE_SPAN || static_cast<size_t>(pc) + 2 * OPCODE_SPAN > sizeof this->state.ram) return 0;
+
+    const auto load = (this->state.ram[pc - 2] << 8) | this->state.ram[pc - 1];
+    const auto skip = (this->state.ram[pc] << 8) | this->state.ram[pc + 1];
+    const auto jump = (this->state.ram[pc + 2] << 8) | this->state.ram[pc + 3];
+
+    // Just past FX07, with Vx still holding DT: every further pass through the loop loads the same value and jumps back
+    const auto x = (load >> 8) & 0xf;
+    if((load & 0xf0ff) != 0xf007 || this->state.v[x] != this->state.dt) return 0;
+    if(skip != (0x3000 | (x << 8)) || jump != (0x1000 | (pc - OPCODE_SPAN))) return 0;
+
+    // Whole passes only, so the loop is left at the same instruction it would have reached
+    return cycles - cycles % 3;
+}
+
+FaultStatus CPU::cycle() {
+    if(this->fault.fault != Fault::NONE) return this->fault;
+
+    switch(this->profile) {
+        case Profile::REFERENCE: this->step<QUIRKS(REFERENCE)>(); break;
+        case Profile::CHIP8: this->step<QUIRKS(CHIP8)>(); break;
+        case Profile::SCHIP: this->step<QUIRKS(SCHIP)>(); break;
+        case Profile::XOCHIP: this->step<QUIRKS(XOCHIP)>(); break;
+        case Profile::COUNT: break;
     }
+    return this->fault;
 }
 
-void CPU::cycle() {
-    const auto opcode = this->fetch_opcode();
-    if(opcode == '\0') return;
+template<Quirks Q>
+void CPU::step() {
+    static_assert(std::size(handlers<Q>) == static_cast<size_t>(Operation::COUNT));
 
-    this->execute(opcode);
-    if(this->blocked) this->pc -= 2; // Go back to the last instruction
+    const auto instruction = this->fetch_instruction();
+    (this->*handlers<Q>[static_cast<size_t>(instruction.operation)])(instruction);
+    if(this->state.blocked) this->state.pc -= 2; // Go back to the last instruction
 }
 
+FaultStatus CPU::run(uint64_t cycles) {
+    NullProfiler profiler;
+    return this->run(cycles, profiler);
+}
+
+template<typename Policy>
+FaultStatus CPU::run(uint64_t cycles, Policy& profiler) {
+    if(this->fault.fault != Fault::NONE) return this->fault;
+
+    // Picked once per call, the loop itself never looks at the profile
+    switch(this->profile) {
+        case Profile::REFERENCE: return this->execute<QUIRKS(REFERENCE)>(cycles, profiler);
+        case Profile::CHIP8: return this->execute<QUIRKS(CHIP8)>(cycles, profiler);
+        case Profile::SCHIP: return this->execute<QUIRKS(SCHIP)>(cycles, profiler);
+        case Profile::XOCHIP: return this->execute<QUIRKS(XOCHIP)>(cycles, profiler);
+        case Profile::COUNT: break;
+    }
+    return this->fault;
+}
+
+FaultStatus CPU::stopped(const uint64_t cycles) const {
+    auto status = this->fault;
+    status.cycles = cycles;
+    return status;
+}
+
+template<Quirks Q, typename Policy>
+FaultStatus CPU::execute(uint64_t cycles, Policy& profiler) {
+    const auto requested = cycles;
+
+#if defined(__GNUC__)
+    // Threaded code: every handler jumps straight to the next one, so each gets its own indirect branch to predict
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    // Indexed by Operation, like this->handlers<Q>
+    static void* const labels[] = {
+        &&label_unknown,
+        &&label_sys,
+        &&label_cls,
+        &&label_ret,
+        &&label_scd,
+        &&label_scr,
+        &&label_scl,
+        &&label_low,
+        &&label_high,
+        &&label_jp,
+        &&label_call,
+        &&label_se_byte,
+        &&label_sne_byte,
+        &&label_se_register,
+        &&label_ld_byte,
+        &&label_add_byte,
+        &&label_ld_register,
+        &&label_or,
+        &&label_and,
+        &&label_xor,
+        &&label_add_register,
+        &&label_sub,
+        &&label_shr,
+        &&label_subn,
+        &&label_shl,
+        &&label_sne_register,
+        &&label_ld_i,
+        &&label_jp_v0,
+        &&label_rnd,
+        &&label_drw,
+        &&label_skp,
+        &&label_sknp,
+        &&label_ld_vx_dt,
+        &&label_ld_vx_k,
+        &&label_ld_dt_vx,
+        &&label_ld_st_vx,
+        &&label_add_i,
+        &&label_ld_f,
+        &&label_ld_b,
+        &&label_ld_memory_vx,
+        &&label_ld_vx_memory,
+        &&label_ld_audio,
+        &&label_ld_pitch,
+        &&label_unknown,
+    };
+    static_assert(std::size(labels) == static_cast<size_t>(Operation::COUNT));
+
+#define DISPATCH() \
+    if(cycles == 0) return this->stopped(requested); \
+    cycles--; \
+    { \
+        auto& entry = this->decoded[this->state.pc & ADDRESS_MASK]; \
+        if(entry.operation == Operation::UNDECODED) entry = this->decode(this->fetch_opcode()); \
+        instruction = entry; \
+    } \
+    profiler.instruction(this->state, instruction); \
+    this->state.pc += OPCODE_SPAN; \
+    goto *labels[static_cast<size_t>(instruction.operation)]
+
+#define NEXT() \
+    profiler.retired(this->state, instruction); \
+    if(this->state.blocked) this->state.pc -= 2; \
+    DISPATCH()
+
+    // For the few handlers that can fault, so the others pay nothing for it. The faulting instruction was already counted off
+#define CHECKED_NEXT() \
+    profiler.retired(this->state, instruction); \
+    if(this->fault.fault != Fault::NONE) return this->stopped(requested - cycles - 1); \
+    if(this->state.blocked) this->state.pc -= 2; \
+    DISPATCH()
+
+    Instruction instruction;
+    DISPATCH();
+
+    label_sys: this->op_sys(instruction); NEXT();
+    label_cls: this->op_cls(instruction); NEXT();
+    label_ret: this->op_ret(instruction); CHECKED_NEXT();
+    label_scd: this->op_scd<Q>(instruction); NEXT();
+    label_scr: this->op_scr<Q>(instruction); NEXT();
+    label_scl: this->op_scl<Q>(instruction); NEXT();
+    label_low: this->op_low<Q>(instruction); NEXT();
+    label_high: this->op_high<Q>(instruction); NEXT();
+    label_jp: this->op_jp(instruction); NEXT();
+    label_call: this->op_call(instruction); CHECKED_NEXT();
+    label_se_byte: this->op_se_byte(instruction); NEXT();
+    label_sne_byte: this->op_sne_byte(instruction); NEXT();
+    label_se_register: this->op_se_register(instruction); NEXT();
+    label_ld_byte: this->op_ld_byte(instruction); NEXT();
+    label_add_byte: this->op_add_byte(instruction); NEXT();
+    label_ld_register: this->op_ld_register(instruction); NEXT();
+    label_or: this->op_or(instruction); NEXT();
+    label_and: this->op_and(instruction); NEXT();
+    label_xor: this->op_xor(instruction); NEXT();
+    label_add_register: this->op_add_register(instruction); NEXT();
+    label_sub: this->op_sub(instruction); NEXT();
+    label_shr: this->op_shr<Q>(instruction); NEXT();
+    label_subn: this->op_subn(instruction); NEXT();
+    label_shl: this->op_shl<Q>(instruction); NEXT();
+    label_sne_register: this->op_sne_register(instruction); NEXT();
+    label_ld_i: this->op_ld_i(instruction); NEXT();
+    label_jp_v0: this->op_jp_v0<Q>(instruction); NEXT();
+    label_rnd: this->op_rnd(instruction); NEXT();
+    label_drw: this->op_drw<Q>(instruction); CHECKED_NEXT();
+    label_skp: this->op_skp(instruction); NEXT();
+    label_sknp: this->op_sknp(instruction); NEXT();
+    label_ld_vx_dt: this->op_ld_vx_dt(instruction); cycles -= this->idle_cycles(cycles); NEXT();
+    label_ld_vx_k: this->op_ld_vx_k(instruction); cycles -= this->idle_cycles(cycles); NEXT();
+    label_ld_dt_vx: this->op_ld_dt_vx(instruction); NEXT();
+    label_ld_st_vx: this->op_ld_st_vx(instruction); NEXT();
+    label_add_i: this->op_add_i(instruction); NEXT();
+    label_ld_f: this->op_ld_f(instruction); NEXT();
+    label_ld_b: this->op_ld_b(instruction); CHECKED_NEXT();
+    label_ld_memory_vx: this->op_ld_memory_vx<Q>(instruction); CHECKED_NEXT();
+    label_ld_vx_memory: this->op_ld_vx_memory<Q>(instruction); CHECKED_NEXT();
+    label_ld_audio: this->op_ld_audio<Q>(instruction); CHECKED_NEXT();
+    label_ld_pitch: this->op_ld_pitch<Q>(instruction); CHECKED_NEXT();
+    label_unknown: this->op_unknown(instruction); CHECKED_NEXT();
+
+#undef DISPATCH
+#undef NEXT
+#undef CHECKED_NEXT
+#pragma GCC diagnostic pop
+#else
+    while(cycles > 0) {
+        // Decodes ahead of this->cycle, which then finds the entry cached
+        auto& entry = this->decoded[this->state.pc & ADDRESS_MASK];
+        if(entry.operation == Operation::UNDECODED) entry = this->decode(this->fetch_opcode());
+        const auto instruction = entry;
+
+        profiler.instruction(this->state, instruction);
+        this->step<Q>();
+        profiler.retired(this->state, instruction);
+        if(this->fault.fault != Fault::NONE) break;
+        cycles--;
+        cycles -= this->idle_cycles(cycles);
+    }
+    return this->stopped(requested - cycles);
+#endif
+}
+
+template FaultStatus CPU::run<NullProfiler>(uint64_t, NullProfiler&);
+template FaultStatus CPU::run<Profiler>(uint64_t, Profiler&);
+template FaultStatus CPU::run<Tracer>(uint64_t, Tracer&);
+
 void CPU::tick() {
-    if(this->dt > 0) this->dt--;
-    if(this->st > 0) this->st--;
+    if(this->state.dt > 0) this->state.dt--;
+    if(this->state.st > 0) this->state.st--;
 }
 
 #undef PROGRAMS_OFFSET
+#undef QUIRKS
 #undef OPCODE_SPAN
-#undef debug_log
-#undef FONT_LENGTH
-#undef KEY_UP
-#undef KEY_DOWN
+#undef ADDRESS_MASK
+#undef BYTES_PER_FONT
+#undef WIDE_SPRITE_BYTES
+#undef DEFAULT_PATTERN
+#undef DEFAULT_PITCH
+#undef FNV_OFFSET_BASIS
+#undef FNV_PRIME
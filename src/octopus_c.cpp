@@ -0,0 +1,102 @@
+#include <cstring>
+#include <exception>
+#include <new>
+
+#include "octopus.h"
+#include "octopus_c.h"
+#include "savestate.h"
+
+static_assert(OCTO_UNKNOWN_OPCODE == static_cast<int>(Fault::UNKNOWN_OPCODE));
+static_assert(OCTO_STACK_UNDERFLOW == static_cast<int>(Fault::STACK_UNDERFLOW));
+static_assert(OCTO_STACK_OVERFLOW == static_cast<int>(Fault::STACK_OVERFLOW));
+static_assert(OCTO_OUT_OF_BOUNDS == static_cast<int>(Fault::OUT_OF_BOUNDS));
+
+struct octo_instance {
+    CPU processor;
+};
+
+octo_instance* octo_create(const uint64_t seed) {
+    auto* instance = new(std::nothrow) octo_instance;
+    if(instance != nullptr) instance->processor.init(seed);
+    return instance;
+}
+
+void octo_destroy(octo_instance* instance) {
+    delete instance;
+}
+
+int octo_load(octo_instance* instance, const uint8_t* rom, const size_t size) {
+    // Exceptions must not cross into C
+    try {
+        instance->processor.load({rom, size});
+    } catch(const std::exception&) {
+        return OCTO_ERROR;
+    }
+    return OCTO_OK;
+}
+
+int octo_set_profile(octo_instance* instance, const char* name) {
+    Profile profile;
+    if(name == nullptr || !parse_profile(name, profile)) return OCTO_ERROR;
+    instance->processor.set_profile(profile);
+    return OCTO_OK;
+}
+
+void octo_set_key(octo_instance* instance, const uint8_t key, const int pressed) {
+    instance->processor.set_key(key, pressed != 0);
+}
+
+int octo_run_frames(octo_instance* instance, const uint32_t frames, const uint32_t instructions_per_frame) {
+    auto& processor = instance->processor;
+    for(uint32_t frame = 0; frame < frames; frame++) {
+        if(processor.run(instructions_per_frame).fault != Fault::NONE) break;
+        processor.tick();
+    }
+    return static_cast<int>(processor.get_fault().fault);
+}
+
+uint16_t octo_fault_address(const octo_instance* instance) {
+    const auto& fault = instance->processor.get_fault();
+    return (fault.fault == Fault::NONE) ? 0 : fault.pc;
+}
+
+size_t octo_framebuffer(const octo_instance* instance, uint8_t* pixels, const size_t capacity, uint32_t* width, uint32_t* height) {
+    const auto& framebuffer = instance->processor.get_framebuffer();
+    const size_t bytes_per_row = framebuffer.get_width() / 8;
+    const size_t size = bytes_per_row * framebuffer.get_height();
+    if(width != nullptr) *width = framebuffer.get_width();
+    if(height != nullptr) *height = framebuffer.get_height();
+    if(pixels == nullptr || capacity < size) return 0;
+
+    for(uint8_t y = 0; y < framebuffer.get_height(); y++) {
+        for(size_t byte = 0; byte < bytes_per_row; byte++) {
+            *pixels++ = static_cast<uint8_t>(framebuffer.get_word(byte / 8, y) >> (56 - byte % 8 * 8));
+        }
+    }
+    return size;
+}
+
+uint64_t octo_framebuffer_hash(const octo_instance* instance) {
+    return instance->processor.get_framebuffer().hash();
+}
+
+size_t octo_state_size(void) {
+    return sizeof(State);
+}
+
+int octo_snapshot(const octo_instance* instance, void* buffer, const size_t size) {
+    if(buffer == nullptr || size != sizeof(State)) return OCTO_ERROR;
+    // Through a State of its own, as the buffer may not be aligned for one
+    State state;
+    instance->processor.snapshot(state);
+    std::memcpy(buffer, &state, sizeof state);
+    return OCTO_OK;
+}
+
+int octo_restore(octo_instance* instance, const void* buffer, const size_t size) {
+    if(buffer == nullptr || size != sizeof(State) || !is_valid_state(static_cast<const uint8_t*>(buffer))) return OCTO_ERROR;
+    State state;
+    std::memcpy(&state, buffer, sizeof state);
+    instance->processor.restore(state);
+    return OCTO_OK;
+}
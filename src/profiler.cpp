@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "profiler.h"
+
+#define HEATMAP_WIDTH 64
+
+// Indexed by Operation
+static const char* const operation_names[] = {
+    "undecoded", "sys", "cls", "ret", "scd", "scr", "scl", "low", "high", "jp", "call",
+    "se_byte", "sne_byte", "se_register", "ld_byte", "add_byte",
+    "ld_register", "or", "and", "xor", "add_register", "sub", "shr", "subn", "shl",
+    "sne_register", "ld_i", "jp_v0", "rnd", "drw", "skp", "sknp",
+    "ld_vx_dt", "ld_vx_k", "ld_dt_vx", "ld_st_vx", "add_i", "ld_f", "ld_b", "ld_memory_vx", "ld_vx_memory",
+    "ld_audio", "ld_pitch", "unknown",
+};
+static_assert(std::size(operation_names) == static_cast<size_t>(Operation::COUNT));
+
+void Profiler::end_frame() {
+    this->draws_per_frame[std::min<size_t>(this->draws, MAX_DRAWS)]++;
+    this->draws = 0;
+    this->frames++;
+}
+
+void Profiler::write(const std::string file_path) const {
+    std::ofstream file(file_path);
+    if(!file.is_open()) {
+        throw std::runtime_error(std::format("could not open profile: {}\n", file_path));
+    }
+
+    const auto total = std::accumulate(std::begin(this->addresses), std::end(this->addresses), uint64_t{0});
+    file << std::format("{{\n  \"instructions\": {},\n  \"frames\": {},\n", total, this->frames);
+    file << std::format("  \"emulation_seconds\": {:.6f},\n  \"presentation_seconds\": {:.6f},\n", this->emulation_seconds, this->presentation_seconds);
+
+    file << "  \"operations\": {";
+    auto separator = "";
+    for(size_t index = 0; index < std::size(this->operations); index++) {
+        if(this->operations[index] == 0) continue;
+        file << std::format("{}\n    \"{}\": {}", separator, operation_names[index], this->operations[index]);
+        separator = ",";
+    }
+    file << "\n  },\n";
+
+    file << "  \"draws_per_frame\": [";
+    for(size_t index = 0; index <= MAX_DRAWS; index++) file << std::format("{}{}", (index > 0) ? ", " : "", this->draws_per_frame[index]);
+    file << "],\n";
+
+    // Row r holds the counts of addresses r * 64 to r * 64 + 63
+    file << "  \"heatmap\": [";
+    for(size_t row = 0; row < std::size(this->addresses) / HEATMAP_WIDTH; row++) {
+        file << ((row > 0) ? ",\n    [" : "\n    [");
+        for(size_t column = 0; column < HEATMAP_WIDTH; column++) {
+            file << std::format("{}{}", (column > 0) ? ", " : "", this->addresses[row * HEATMAP_WIDTH + column]);
+        }
+        file << "]";
+    }
+    file << "\n  ],\n";
+
+    std::vector<uint16_t> order(std::size(this->addresses));
+    std::iota(order.begin(), order.end(), 0);
+    const auto top = std::min(TOP_ADDRESSES, order.size());
+    std::partial_sort(order.begin(), order.begin() + top, order.end(), [this](const uint16_t a, const uint16_t b) {
+        return this->addresses[a] > this->addresses[b];
+    });
+
+    file << "  \"top\": [";
+    separator = "";
+    for(size_t index = 0; index < top && this->addresses[order[index]] > 0; index++) {
+        const auto count = this->addresses[order[index]];
+        file << std::format("{}\n    {{\"address\": \"0x{:03x}\", \"count\": {}, \"share\": {:.4f}}}", separator, order[index], count, static_cast<double>(count) / total);
+        separator = ",";
+    }
+    file << "\n  ]\n}\n";
+}
+
+#undef HEATMAP_WIDTH
@@ -0,0 +1,32 @@
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "quirks.h"
+
+bool find_profile(const std::string file_path, const uint64_t rom_hash, Profile& profile) {
+    std::ifstream file(file_path);
+    if(!file.is_open()) {
+        throw std::runtime_error(std::format("could not open quirks database: {}\n", file_path));
+    }
+
+    std::string line;
+    for(size_t number = 1; std::getline(file, line); number++) {
+        if(line.empty() || line.starts_with('#')) continue;
+
+        std::istringstream fields(line);
+        uint64_t hash;
+        std::string name;
+        Profile listed;
+        if(!(fields >> std::hex >> hash >> name) || !parse_profile(name, listed)) {
+            throw std::runtime_error(std::format("{}:{}: expected a rom hash and a profile\n", file_path, number));
+        }
+
+        if(hash != rom_hash) continue;
+        profile = listed;
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,101 @@
+#include <bit>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "recording.h"
+#include "serial.h"
+
+#define MAGIC "OCTR"
+#define VERSION 1
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325
+#define FNV_PRIME 0x100000001b3
+
+void Recording::record(const uint64_t frame, const uint16_t keys) {
+    const uint16_t last = this->changes.empty() ? 0 : this->changes.back().keys;
+    if(keys != last) this->changes.push_back({frame, keys});
+}
+
+void Recording::queue(InputQueue& input) const {
+    uint16_t last = 0;
+    for(const auto& change : this->changes) {
+        for(uint16_t flipped = change.keys ^ last; flipped != 0; flipped &= flipped - 1) {
+            const uint8_t key = std::countr_zero(flipped);
+            input.push({change.frame, key, ((change.keys >> key) & 1) != 0});
+        }
+        last = change.keys;
+    }
+}
+
+void write_recording(const std::string file_path, const Recording& recording) {
+    std::string bytes(MAGIC);
+    put_fixed(bytes, VERSION, sizeof(uint32_t));
+    put_fixed(bytes, recording.rom_hash, sizeof recording.rom_hash);
+    put_fixed(bytes, recording.seed, sizeof recording.seed);
+    put_fixed(bytes, recording.instructions_per_frame, sizeof recording.instructions_per_frame);
+    put_fixed(bytes, static_cast<uint8_t>(recording.profile), sizeof recording.profile);
+    put_fixed(bytes, recording.state_hash, sizeof recording.state_hash);
+    put_varint(bytes, recording.frames);
+    put_varint(bytes, recording.changes.size());
+
+    uint64_t frame = 0;
+    for(const auto& change : recording.changes) {
+        put_varint(bytes, change.frame - frame);
+        put_fixed(bytes, change.keys, sizeof change.keys);
+        frame = change.frame;
+    }
+
+    std::ofstream file(file_path, std::ios::binary);
+    if(!file.is_open() || !file.write(bytes.data(), bytes.size())) {
+        throw std::runtime_error(std::format("could not write recording: {}\n", file_path));
+    }
+}
+
+void read_recording(const std::string file_path, Recording& recording) {
+    std::ifstream file(file_path, std::ios::binary);
+    if(!file.is_open()) {
+        throw std::runtime_error(std::format("could not open recording: {}\n", file_path));
+    }
+
+    const std::string bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if(!bytes.starts_with(MAGIC)) {
+        throw std::runtime_error(std::format("not a recording: {}\n", file_path));
+    }
+
+    ByteReader reader{bytes, sizeof MAGIC - 1, "recording"};
+    const auto version = reader.fixed(sizeof(uint32_t));
+    if(version != VERSION) {
+        throw std::runtime_error(std::format("recording version not supported: {}\n", version));
+    }
+
+    recording.rom_hash = reader.fixed(sizeof recording.rom_hash);
+    recording.seed = reader.fixed(sizeof recording.seed);
+    recording.instructions_per_frame = reader.fixed(sizeof recording.instructions_per_frame);
+    recording.profile = static_cast<Profile>(reader.fixed(sizeof recording.profile));
+    if(recording.profile >= Profile::COUNT) throw std::runtime_error("malformed recording\n");
+    recording.state_hash = reader.fixed(sizeof recording.state_hash);
+    recording.frames = reader.varint();
+
+    const auto count = reader.varint();
+    recording.changes.clear();
+    uint64_t frame = 0;
+    for(uint64_t index = 0; index < count; index++) {
+        frame += reader.varint();
+        recording.changes.push_back({frame, static_cast<uint16_t>(reader.fixed(sizeof(uint16_t)))});
+    }
+}
+
+uint64_t hash_rom(const std::span<const uint8_t> rom) {
+    uint64_t result = FNV_OFFSET_BASIS;
+    for(const auto byte : rom) {
+        result ^= byte;
+        result *= FNV_PRIME;
+    }
+    return result;
+}
+
+#undef MAGIC
+#undef VERSION
+#undef FNV_OFFSET_BASIS
+#undef FNV_PRIME
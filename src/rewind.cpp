@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <cstring>
+
+#include "rewind.h"
+
+#define LENGTH_SIZE sizeof(uint16_t)
+
+Rewind::Rewind(const size_t capacity) : ring(capacity), head(0), tail(0), used(0), records(0), has_current(false) {}
+
+void Rewind::clear() {
+    this->head = 0;
+    this->tail = 0;
+    this->used = 0;
+    this->records = 0;
+    this->has_current = false;
+}
+
+size_t Rewind::depth() const {
+    return this->records;
+}
+
+void Rewind::write(const size_t offset, const void* source, const size_t size) {
+    const auto bytes = static_cast<const uint8_t*>(source);
+    const auto first = std::min(size, this->ring.size() - offset);
+    std::memcpy(this->ring.data() + offset, bytes, first);
+    std::memcpy(this->ring.data(), bytes + first, size - first);
+}
+
+void Rewind::read(const size_t offset, void* destination, const size_t size) const {
+    const auto bytes = static_cast<uint8_t*>(destination);
+    const auto first = std::min(size, this->ring.size() - offset);
+    std::memcpy(bytes, this->ring.data() + offset, first);
+    std::memcpy(bytes + first, this->ring.data(), size - first);
+}
+
+void Rewind::drop_oldest() {
+    uint16_t length;
+    this->read(this->tail, &length, LENGTH_SIZE);
+
+    const auto total = length + 2 * LENGTH_SIZE;
+    this->tail = (this->tail + total) % this->ring.size();
+    this->used -= total;
+    this->records--;
+}
+
+void Rewind::push(const State& state) {
+    if(!this->has_current) {
+        std::memcpy(&this->current, &state, sizeof state);
+        this->has_current = true;
+        return;
+    }
+
+    const uint16_t length = encode_delta(reinterpret_cast<const uint8_t*>(&this->current), reinterpret_cast<const uint8_t*>(&state), sizeof state, this->scratch);
+    std::memcpy(&this->current, &state, sizeof state);
+
+    // Each record is framed by its length on both sides, so the ring can be walked from either end
+    const auto total = length + 2 * LENGTH_SIZE;
+    if(total > this->ring.size()) {
+        // Too large to keep, and the history before it is now unreachable
+        while(this->records > 0) this->drop_oldest();
+        return;
+    }
+    while(this->ring.size() - this->used < total) this->drop_oldest();
+
+    this->write(this->head, &length, LENGTH_SIZE);
+    this->write((this->head + LENGTH_SIZE) % this->ring.size(), this->scratch, length);
+    this->write((this->head + LENGTH_SIZE + length) % this->ring.size(), &length, LENGTH_SIZE);
+
+    this->head = (this->head + total) % this->ring.size();
+    this->used += total;
+    this->records++;
+}
+
+bool Rewind::pop(State& state) {
+    if(this->records == 0) return false;
+
+    const auto size = this->ring.size();
+    uint16_t length;
+    this->read((this->head + size - LENGTH_SIZE) % size, &length, LENGTH_SIZE);
+
+    const auto total = length + 2 * LENGTH_SIZE;
+    const auto start = (this->head + size - total) % size;
+    this->read((start + LENGTH_SIZE) % size, this->scratch, length);
+    decode_delta(this->scratch, length, reinterpret_cast<uint8_t*>(&this->current), sizeof this->current);
+
+    this->head = start;
+    this->used -= total;
+    this->records--;
+
+    std::memcpy(&state, &this->current, sizeof this->current);
+    return true;
+}
+
+#undef LENGTH_SIZE
@@ -0,0 +1,66 @@
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#include "rom.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAPPED_FILES
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RomImage::RomImage(const std::string file_path) : data(nullptr), size(0), mapped(false) {
+    if(file_path == "-") {
+        this->buffer.assign(std::istreambuf_iterator<char>(std::cin), std::istreambuf_iterator<char>());
+        this->data = this->buffer.data();
+        this->size = this->buffer.size();
+        return;
+    }
+
+#if defined(MAPPED_FILES)
+    const auto descriptor = open(file_path.c_str(), O_RDONLY);
+    if(descriptor < 0) {
+        throw std::runtime_error(std::format("could not open rom: {}\n", file_path));
+    }
+
+    struct stat status;
+    if(fstat(descriptor, &status) == 0 && status.st_size > 0) {
+        void* memory = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if(memory != MAP_FAILED) {
+            this->data = static_cast<const uint8_t*>(memory);
+            this->size = status.st_size;
+            this->mapped = true;
+        }
+    }
+    close(descriptor);
+
+    // Empty files cannot be mapped, and neither can pipes or some special files. Those are read instead
+    if(this->mapped) return;
+#endif
+
+    std::ifstream file(file_path, std::ios::binary);
+    if(!file.is_open()) {
+        throw std::runtime_error(std::format("could not open rom: {}\n", file_path));
+    }
+
+    this->buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    this->data = this->buffer.data();
+    this->size = this->buffer.size();
+}
+
+RomImage::~RomImage() {
+#if defined(MAPPED_FILES)
+    if(this->mapped) munmap(const_cast<uint8_t*>(this->data), this->size);
+#endif
+}
+
+std::span<const uint8_t> RomImage::bytes() const {
+    return {this->data, this->size};
+}
+
+#undef MAPPED_FILES
@@ -0,0 +1,30 @@
+#include "runahead.h"
+
+bool run_ahead(CPU& processor, JIT* recompiler, const uint32_t frames, const uint32_t instructions_per_frame, State& present, TripleBuffer<Framebuffer>& presented, const bool predicted) {
+    auto& framebuffer = processor.get_framebuffer();
+    const auto drawn = framebuffer.is_dirty();
+    framebuffer.set_clean();
+    processor.snapshot(present);
+
+    // Neither profiled nor traced, as these frames are thrown away
+    for(uint32_t frame = 0; frame < frames; frame++) {
+        const auto status = (recompiler != nullptr) ? recompiler->run(instructions_per_frame) : processor.run(instructions_per_frame);
+        if(status.fault != Fault::NONE) break;
+        processor.tick();
+    }
+
+    // The frame last presented must be replaced even if nothing was drawn since, when it was drawn in frames that may not happen anymore
+    const auto drawn_ahead = framebuffer.is_dirty();
+    if(drawn || drawn_ahead || predicted) {
+        framebuffer.set_dirty();
+        presented.write(framebuffer);
+    }
+
+    if(recompiler != nullptr) {
+        recompiler->restore(present);
+    } else {
+        processor.restore(present);
+    }
+    framebuffer.set_clean();
+    return drawn_ahead;
+}
@@ -0,0 +1,70 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+
+#include "savestate.h"
+
+#define MAGIC "OCTS"
+// Must be bumped whenever the layout of State changes
+#define VERSION 3
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint32_t size;
+};
+
+void write_state(const std::string file_path, const State& state) {
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof header.magic);
+    header.version = VERSION;
+    header.size = sizeof state;
+
+    std::ofstream file(file_path, std::ios::binary);
+    if(!file.is_open()) {
+        throw std::runtime_error(std::format("could not open save state: {}\n", file_path));
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof header);
+    file.write(reinterpret_cast<const char*>(&state), sizeof state);
+    if(!file) {
+        throw std::runtime_error(std::format("could not write save state: {}\n", file_path));
+    }
+}
+
+void read_state(const std::string file_path, State& state) {
+    std::ifstream file(file_path, std::ios::binary);
+    if(!file.is_open()) {
+        throw std::runtime_error(std::format("could not open save state: {}\n", file_path));
+    }
+
+    Header header;
+    if(!file.read(reinterpret_cast<char*>(&header), sizeof header) || std::memcmp(header.magic, MAGIC, sizeof header.magic) != 0) {
+        throw std::runtime_error(std::format("not a save state: {}\n", file_path));
+    }
+    if(header.version != VERSION || header.size != sizeof state) {
+        throw std::runtime_error(std::format("save state version not supported: {}\n", header.version));
+    }
+
+    // Read into a copy, so a truncated file leaves the provided state untouched
+    State loaded;
+    if(!file.read(reinterpret_cast<char*>(&loaded), sizeof loaded)) {
+        throw std::runtime_error(std::format("truncated save state: {}\n", file_path));
+    }
+    if(!is_valid_state(reinterpret_cast<const uint8_t*>(&loaded))) {
+        throw std::runtime_error(std::format("invalid save state: {}\n", file_path));
+    }
+    std::memcpy(&state, &loaded, sizeof loaded);
+}
+
+bool is_valid_state(const uint8_t* bytes) {
+    return bytes[offsetof(State, sp)] <= sizeof(State::stack) / sizeof(State::stack[0])
+        && bytes[offsetof(State, blocked)] <= 1
+        && Framebuffer::is_valid(bytes + offsetof(State, framebuffer));
+}
+
+#undef MAGIC
+#undef VERSION
@@ -0,0 +1,47 @@
+#include <thread>
+
+#include "scheduler.h"
+
+// Frames the scheduler catches up on at once before giving up on the lost time, e.g. after the host was suspended
+#define MAX_CATCH_UP 5
+
+Scheduler::Scheduler(const uint32_t instructions, const bool throttle) :
+    start(Clock::now()), frames(0), throttled(throttle), instructions_per_frame(instructions) {}
+
+Scheduler::Clock::time_point Scheduler::deadline(const uint64_t frame) const {
+    // Computed from the frame count instead of accumulated, so the 16.67 ms period never drifts
+    const auto nanoseconds = std::chrono::nanoseconds(frame * std::nano::den / FRAME_RATE);
+    return this->start + std::chrono::duration_cast<Clock::duration>(nanoseconds);
+}
+
+uint64_t Scheduler::frames_due() {
+    if(!this->throttled) {
+        this->frames++;
+        return 1;
+    }
+
+    const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - this->start).count();
+    const uint64_t target = elapsed * FRAME_RATE / std::nano::den;
+    if(target <= this->frames) return 0;
+
+    auto due = target - this->frames;
+    if(due > MAX_CATCH_UP) {
+        this->frames = target - MAX_CATCH_UP;
+        due = MAX_CATCH_UP;
+    }
+
+    this->frames += due;
+    return due;
+}
+
+void Scheduler::wait() {
+    if(!this->throttled) return;
+    std::this_thread::sleep_until(this->deadline(this->frames + 1));
+}
+
+void Scheduler::restart() {
+    this->start = Clock::now();
+    this->frames = 0;
+}
+
+#undef MAX_CATCH_UP
@@ -0,0 +1,30 @@
+#include <format>
+#include <stdexcept>
+
+#include "serial.h"
+
+void put_fixed(std::string& bytes, uint64_t value, const size_t size) {
+    for(size_t index = 0; index < size; index++, value >>= 8) bytes.push_back(static_cast<char>(value & 0xff));
+}
+
+void put_varint(std::string& bytes, uint64_t value) {
+    for(; value >= 0x80; value >>= 7) bytes.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    bytes.push_back(static_cast<char>(value));
+}
+
+uint64_t ByteReader::fixed(const size_t size) {
+    if(this->bytes.size() - this->offset < size) throw std::runtime_error(std::format("truncated {}\n", this->name));
+    uint64_t value = 0;
+    for(size_t index = 0; index < size; index++) value |= static_cast<uint64_t>(static_cast<uint8_t>(this->bytes[this->offset++])) << (8 * index);
+    return value;
+}
+
+uint64_t ByteReader::varint() {
+    uint64_t value = 0;
+    for(uint32_t shift = 0; shift < 64; shift += 7) {
+        const auto byte = this->fixed(1);
+        value |= (byte & 0x7f) << shift;
+        if(!(byte & 0x80)) return value;
+    }
+    throw std::runtime_error(std::format("malformed {}\n", this->name));
+}
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "serial.h"
+#include "trace.h"
+
+#define MAGIC "OCTT"
+#define VERSION 1
+#define RECORD_SIZE 8
+
+Tracer::Tracer(const size_t capacity) : ring(capacity), pending{} {}
+
+void Tracer::write(const std::string file_path) const {
+    const auto count = std::min<uint64_t>(this->written, this->ring.size());
+    // Until the ring wraps around for the first time, the oldest record is the first one
+    const auto oldest = (this->written > this->ring.size()) ? this->next : 0;
+
+    std::string bytes(MAGIC);
+    put_fixed(bytes, VERSION, sizeof(uint32_t));
+    put_fixed(bytes, this->written, sizeof this->written);
+    put_fixed(bytes, count, sizeof count);
+    for(uint64_t index = 0; index < count; index++) {
+        const auto& record = this->ring[(oldest + index) % this->ring.size()];
+        put_fixed(bytes, record.pc, sizeof record.pc);
+        put_fixed(bytes, record.opcode, sizeof record.opcode);
+        put_fixed(bytes, record.i, sizeof record.i);
+        put_fixed(bytes, record.vx, sizeof record.vx);
+        put_fixed(bytes, record.vf, sizeof record.vf);
+    }
+
+    std::ofstream file(file_path, std::ios::binary);
+    if(!file.is_open() || !file.write(bytes.data(), bytes.size())) {
+        throw std::runtime_error(std::format("could not write trace: {}\n", file_path));
+    }
+}
+
+uint64_t read_trace(const std::string file_path, std::vector<TraceRecord>& records) {
+    std::ifstream file(file_path, std::ios::binary);
+    if(!file.is_open()) {
+        throw std::runtime_error(std::format("could not open trace: {}\n", file_path));
+    }
+
+    const std::string bytes{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    constexpr size_t header = sizeof MAGIC - 1 + sizeof(uint32_t) + 2 * sizeof(uint64_t);
+    if(!bytes.starts_with(MAGIC) || bytes.size() < header) {
+        throw std::runtime_error(std::format("not a trace: {}\n", file_path));
+    }
+
+    ByteReader reader{bytes, sizeof MAGIC - 1, "trace"};
+    const auto version = reader.fixed(sizeof(uint32_t));
+    if(version != VERSION) {
+        throw std::runtime_error(std::format("trace version not supported: {}\n", version));
+    }
+
+    const auto written = reader.fixed(sizeof(uint64_t));
+    const auto count = reader.fixed(sizeof(uint64_t));
+    if((bytes.size() - header) / RECORD_SIZE < count) {
+        throw std::runtime_error(std::format("truncated trace: {}\n", file_path));
+    }
+
+    records.clear();
+    for(uint64_t index = 0; index < count; index++) {
+        records.push_back({
+            static_cast<uint16_t>(reader.fixed(2)),
+            static_cast<uint16_t>(reader.fixed(2)),
+            static_cast<uint16_t>(reader.fixed(2)),
+            static_cast<uint8_t>(reader.fixed(1)),
+            static_cast<uint8_t>(reader.fixed(1)),
+        });
+    }
+
+    return written;
+}
+
+#undef MAGIC
+#undef VERSION
+#undef RECORD_SIZE
@@ -0,0 +1,68 @@
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "capture.h"
+
+void write_image(const std::string, const CapturedFrame&);
+
+int32_t main(int32_t argc, char* argv[]) {
+    if(argc < 2) {
+        std::cout << std::format("Usage: {} CAPTURE [DIRECTORY]\n", argv[0]);
+        return 1;
+    }
+
+    const auto frames = read_capture(argv[1]);
+    if(argc < 3) {
+        const auto size = std::filesystem::file_size(argv[1]);
+        const auto span = frames.empty() ? 0 : frames.back().frame + 1;
+        std::cout << std::format("{} changed frames out of {}, {} bytes, {:.1f} bytes per changed frame\n",
+            frames.size(), span, size, frames.empty() ? 0.0 : static_cast<double>(size) / frames.size());
+        for(const auto& frame : frames) std::cout << std::format("{:>10} {}\n", frame.frame, frame.hires ? "128x64" : "64x32");
+        return 0;
+    }
+
+    // One image per frame from the first change on, repeating the last change's pixels in between, so the images play back at 60 per second
+    const std::string directory = argv[2];
+    std::filesystem::create_directories(directory);
+    for(size_t index = 0; index < frames.size(); index++) {
+        const auto end = (index + 1 < frames.size()) ? frames[index + 1].frame : frames[index].frame + 1;
+        for(auto frame = frames[index].frame; frame < end; frame++) {
+            write_image(std::format("{}/{:06}.pbm", directory, frame - frames.front().frame), frames[index]);
+        }
+    }
+
+    return 0;
+}
+
+// Binary PBM, which packs pixels the way a capture does. Low resolution frames are doubled, so every image has the same size
+void write_image(const std::string file_path, const CapturedFrame& frame) {
+    constexpr auto bytes_per_row = Framebuffer::WIDTH / 8;
+    std::string bytes = std::format("P4\n{} {}\n", Framebuffer::WIDTH, Framebuffer::HEIGHT);
+    for(uint8_t y = 0; y < Framebuffer::HEIGHT; y++) {
+        for(uint8_t column = 0; column < bytes_per_row; column++) {
+            if(frame.hires) {
+                bytes.push_back(static_cast<char>(frame.image[y * bytes_per_row + column]));
+                continue;
+            }
+
+            // Each source bit becomes two, the high nibble of a byte filling the first output byte and the low nibble the second
+            const uint8_t source = frame.image[(y / 2) * bytes_per_row + column / 2];
+            const uint8_t nibble = (column % 2 == 0) ? (source >> 4) : (source & 0xf);
+            uint8_t doubled = 0;
+            for(uint8_t bit = 0; bit < 4; bit++) {
+                if((nibble >> bit) & 0x01) doubled |= 0b11 << (2 * bit);
+            }
+            bytes.push_back(static_cast<char>(doubled));
+        }
+    }
+
+    std::ofstream file(file_path, std::ios::binary);
+    if(!file.is_open() || !file.write(bytes.data(), bytes.size())) {
+        std::cerr << std::format("could not write image: {}\n", file_path);
+    }
+}
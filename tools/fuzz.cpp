@@ -0,0 +1,69 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+
+#include "octopus.h"
+
+// Frames emulated per input, a second at the default pace, so every input costs about the same
+#define FRAMES 60
+#define INSTRUCTIONS_PER_FRAME 10
+// Space left in ram past the programs offset. Longer inputs are cut, instead of being rejected by CPU::load
+#define MAX_ROM_SIZE (4096 - 0x200)
+
+// Set up once, so every input starts from the same machine with a single copy instead of CPU::init and a file read
+static std::unique_ptr<CPU> processor;
+static State snapshot;
+// Whether inputs are key scripts for the ROM at OCTOPUS_FUZZ_ROM, instead of ROMs
+static bool scripted = false;
+// Whether a fault aborts, so the fuzzer reports inputs that make a ROM or a toolchain's output fault
+static bool abort_on_fault = false;
+
+extern "C" int LLVMFuzzerInitialize(int*, char***) {
+    processor = std::make_unique<CPU>();
+    processor->init(0);
+
+    if(const auto rom_path = std::getenv("OCTOPUS_FUZZ_ROM")) {
+        processor->dump_into_memory(rom_path);
+        scripted = true;
+    }
+    abort_on_fault = (std::getenv("OCTOPUS_FUZZ_ABORT_ON_FAULT") != nullptr);
+
+    processor->snapshot(snapshot);
+    return 0;
+}
+
+// An input is either a ROM, or with OCTOPUS_FUZZ_ROM set, one byte per key event: the high nibble is the amount of frames to run before it and the low nibble the key it toggles
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    processor->restore(snapshot);
+
+    size_t events = 0;
+    if(scripted) {
+        events = size;
+    } else {
+        processor->load({data, std::min<size_t>(size, MAX_ROM_SIZE)});
+    }
+
+    uint32_t wait = (events > 0) ? (data[0] >> 4) : FRAMES;
+    size_t event = 0;
+    for(uint32_t frame = 0; frame < FRAMES; frame++) {
+        // Every event due this frame, several in a row when they wait for none
+        while(event < events && wait == 0) {
+            const uint8_t key = data[event] & 0xf;
+            processor->set_key(key, !((processor->get_keys() >> key) & 0x01));
+            if(++event < events) wait = data[event] >> 4;
+        }
+        if(wait > 0) wait--;
+
+        if(processor->run(INSTRUCTIONS_PER_FRAME).fault != Fault::NONE) break;
+        processor->tick();
+    }
+
+    if(abort_on_fault && processor->get_fault().fault != Fault::NONE) std::abort();
+    return 0;
+}
+
+#undef FRAMES
+#undef INSTRUCTIONS_PER_FRAME
+#undef MAX_ROM_SIZE
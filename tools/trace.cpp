@@ -0,0 +1,31 @@
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "disassembler.h"
+#include "trace.h"
+
+int32_t main(int32_t argc, char* argv[]) {
+    if(argc < 2) {
+        std::cout << std::format("Usage: {} TRACE [LAST]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<TraceRecord> records;
+    const auto written = read_trace(argv[1], records);
+    const uint64_t last = (argc > 2) ? std::stoull(argv[2]) : records.size();
+    const auto first = (last < records.size()) ? records.size() - last : 0;
+
+    // Numbered from the first instruction ever traced, so the numbers of a run's dumps line up
+    const auto base = written - records.size();
+    for(size_t index = first; index < records.size(); index++) {
+        const auto& record = records[index];
+        const auto x = (record.opcode >> 8) & 0xf;
+        std::cout << std::format("{:>10} {:03x}: {:04x}  {:<16} I={:03x} V{:x}={:02x} VF={:02x}\n",
+            base + index, record.pc, record.opcode, disassemble(record.opcode), record.i, x, record.vx, record.vf);
+    }
+
+    return 0;
+}